@@ -0,0 +1,41 @@
+#include <corelock.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Tasks and their data are looked up by name from config_usage.ini, so they
+// must be global and the executable linked with -rdynamic (ENABLE_EXPORTS)
+long fast_counter;
+
+long fast_step(void *arg) {
+    long *counter = arg;
+    (*counter)++;
+    return 0;
+}
+
+long slow_step(void *arg) {
+    (void) arg;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s CONFIG\n", argv[0]);
+        return 1;
+    }
+    // Parses, checks the per-core load and creates every instance
+    struct cl_config_s *cfg = cl_config_load(argv[1]);
+    if (!cfg)
+        return 1;
+
+    if (cl_config_run(cfg) != CL_OK) {
+        cl_config_destroy(cfg);
+        return 1;
+    }
+    sleep(10);
+
+    cl_config_stop(cfg);
+    cl_config_join(cfg, NULL);
+    printf("fast_step ran %ld times\n", fast_counter);
+    cl_config_destroy(cfg);
+    return 0;
+}
@@ -10,6 +10,8 @@ extern "C" {
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 
 /**
  * @brief CoreLock Status and Error Codes.
@@ -32,6 +34,15 @@ typedef enum {
     
     /** @brief Failed to terminate the thread forcefully. */
     CL_ERR_TERM,
+
+    /** @brief Invalid argument or the feature is not enabled for this instance. */
+    CL_ERR_INVAL,
+
+    /** @brief Memory allocation failed. */
+    CL_ERR_NOMEM,
+
+    /** @brief A file could not be opened or written. */
+    CL_ERR_IO,
 } cl_status_t;
 
 /**
@@ -56,6 +67,56 @@ struct cl_instanse_s;
  */
 typedef long (*cl_task)(void *arg);
 
+/** @brief Context of a specialized loop, see CL_DEFINE_LOOP(). */
+typedef struct cl_loop_s cl_loop_t;
+
+/**
+ * @brief Specialized loop replacing the generic cycle loop of an instance.
+ *
+ * @return long Value returned by the thread, as for cl_task.
+ */
+typedef long (*cl_loop_fn)(cl_loop_t *ctx);
+
+/**
+ * @brief Watchdog notification, called on the supervisor thread when an
+ * instance stalls inside its task.
+ *
+ * Runs without the watchdog lock and after CL_WDOG_DEMOTE/CL_WDOG_TERM, so
+ * it may stop, join and destroy the instance. The next poll waits for it.
+ *
+ * @param inst Stalled instance.
+ * @param cycle Index of the cycle the task hangs in.
+ * @param stalled_ns Time the task has run, as seen by the supervisor polls.
+ * @param arg wdog_arg of the instance attributes.
+ */
+typedef void (*cl_wdog_fn)(struct cl_instanse_s *inst, unsigned long long cycle,
+                           unsigned long long stalled_ns, void *arg);
+
+/**
+ * @brief Soft deadline hook, called from the budget_signal handler on the RT
+ * thread while the task runs. Only async-signal-safe code is allowed.
+ *
+ * @param inst Instance whose budget expired.
+ * @param arg Task argument of the instance.
+ */
+typedef void (*cl_budget_fn)(struct cl_instanse_s *inst, void *arg);
+
+/**
+ * @brief Cleanup hook, called once on the RT thread after the last cycle,
+ * also when the thread is cancelled by cl_inst_term().
+ *
+ * @param arg Task argument of the instance.
+ */
+typedef void (*cl_stop_fn)(void *arg);
+
+/**
+ * @brief Background job, run on the RT thread in the slack of its cycles.
+ * Long jobs call cl_job_yield() regularly to give the core back in time.
+ *
+ * @param arg Argument given to cl_inst_submit_job().
+ */
+typedef void (*cl_job_fn)(void *arg);
+
 /**
  * @brief Overrun Behavior (BH) policies.
  * 
@@ -69,8 +130,136 @@ typedef enum {
     CL_OVERRUN_BH_NOTIFY,
     /** @brief Silently continue without any action. */
     CL_OVERRUN_BH_IGNORE,
+    /**
+     * @brief Realign to the next future period boundary instead of running the
+     * missed cycles back-to-back. Missed periods are counted in the stats.
+     */
+    CL_OVERRUN_BH_SKIP,
+    /**
+     * @brief Run at most or_catchup_max late cycles back-to-back, then realign
+     * to the next future period boundary as CL_OVERRUN_BH_SKIP does.
+     */
+    CL_OVERRUN_BH_CATCHUP_N,
+    /**
+     * @brief Notify on each overrun and stop after or_stop_limit consecutive
+     * overruns, or after or_stop_limit overruns within the last
+     * or_stop_window cycles if the window is non-zero.
+     */
+    CL_OVERRUN_BH_STOP_AFTER_K,
 } cl_overrun_bh;
 
+/**
+ * @brief Strategies for waiting until the next period boundary.
+ */
+typedef enum {
+    /**
+     * @brief Sleep until the deadline on the stop flag (absolute
+     * FUTEX_WAIT_BITSET), so cl_inst_stop() wakes the thread at once.
+     * Signals such as budget_signal only make it sleep again, and
+     * cl_inst_term() takes effect when the sleep is over.
+     */
+    CL_WAIT_SLEEP,
+    /** @brief Busy-poll the clock until the deadline. Keeps the core at 100% load. */
+    CL_WAIT_SPIN,
+    /** @brief Sleep until deadline - spin_margin_us, then busy-poll the rest. */
+    CL_WAIT_HYBRID,
+} cl_wait_mode;
+
+/**
+ * @brief What releases a cycle of the loop.
+ */
+typedef enum {
+    /** @brief Absolute-time periodic release every period_us (default). */
+    CL_TRIGGER_PERIODIC,
+    /**
+     * @brief Release when trigger_fd becomes readable (eventfd, timerfd, UIO...).
+     * trigger_read_size bytes are consumed from the fd on each release.
+     */
+    CL_TRIGGER_FD,
+    /** @brief Release when *trigger_flag becomes non-zero (busy-polled, reset to 0 on release). */
+    CL_TRIGGER_FLAG,
+} cl_trigger_mode;
+
+/**
+ * @brief Reference clocks the periodic loop can be phase-locked to.
+ */
+typedef enum {
+    /** @brief Free-running loop (default). */
+    CL_SYNC_NONE,
+    /** @brief Lock cycle boundaries to CLOCK_TAI. */
+    CL_SYNC_TAI,
+    /** @brief Lock cycle boundaries to a PTP hardware clock (sync_phc_path). */
+    CL_SYNC_PHC,
+} cl_sync_source;
+
+/**
+ * @brief Environment checks of an RT core, combined as a bit mask.
+ */
+typedef enum {
+    /** @brief The core is listed in isolcpus. */
+    CL_CORE_ISOLATED = 1 << 0,
+    /** @brief The core runs without the periodic tick (nohz_full). */
+    CL_CORE_NOHZ_FULL = 1 << 1,
+    /** @brief RCU callbacks are offloaded from the core (rcu_nocbs). */
+    CL_CORE_RCU_NOCBS = 1 << 2,
+    /** @brief No IRQ may be delivered to the core. Enforceable for movable IRQs. */
+    CL_CORE_IRQ_AFFINITY = 1 << 3,
+    /** @brief cpufreq governor is "performance" (or cpufreq absent). Enforceable. */
+    CL_CORE_GOVERNOR = 1 << 4,
+    /** @brief Deep C-states are disabled through /dev/cpu_dma_latency. Enforceable. */
+    CL_CORE_DMA_LATENCY = 1 << 5,
+    /** @brief All of the above. */
+    CL_CORE_ALL = (1 << 6) - 1,
+} cl_core_check;
+
+/**
+ * @brief Watchdog reactions to a stalled instance, combined as a bit mask.
+ */
+typedef enum {
+    /** @brief Call wdog_fn, or print to stderr if it is NULL. */
+    CL_WDOG_NOTIFY = 1 << 0,
+    /** @brief Move the RT thread to SCHED_OTHER so the core is no longer starved. */
+    CL_WDOG_DEMOTE = 1 << 1,
+    /** @brief cl_inst_term(); the thread exits at its next cancellation point. */
+    CL_WDOG_TERM = 1 << 2,
+    /** @brief Stop feeding the hardware watchdog while the stall lasts. */
+    CL_WDOG_HW = 1 << 3,
+} cl_wdog_action;
+
+/**
+ * @brief Hardware performance counters sampled around the task, combined as
+ * a bit mask. The bit position is the index in cl_stats_t.pmc.
+ */
+typedef enum {
+    /** @brief CPU cycles. */
+    CL_PMC_CYCLES = 1 << 0,
+    /** @brief Retired instructions. */
+    CL_PMC_INSTRUCTIONS = 1 << 1,
+    /** @brief Last level cache read misses. */
+    CL_PMC_LLC_MISSES = 1 << 2,
+    /** @brief Data TLB read misses. */
+    CL_PMC_DTLB_MISSES = 1 << 3,
+    /** @brief Mispredicted branches. */
+    CL_PMC_BRANCH_MISSES = 1 << 4,
+} cl_pmc_event;
+
+/** @brief Number of cl_pmc_event counters. */
+#define CL_PMC_COUNT 5
+
+/**
+ * @brief Time sources for the periodic loop.
+ */
+typedef enum {
+    /** @brief clock_gettime(CLOCK_MONOTONIC). */
+    CL_CLOCK_MONOTONIC,
+    /**
+     * @brief Free-running CPU counter: invariant TSC (rdtscp) on x86-64,
+     * CNTVCT_EL0 on aarch64. Calibrated against CLOCK_MONOTONIC once in
+     * cl_inst_create(); deadlines are then computed in raw counter ticks.
+     */
+    CL_CLOCK_CPU_COUNTER,
+} cl_clock_source;
+
 /**
  * @brief Configuration attributes for a CoreLock instance.
  * 
@@ -86,6 +275,15 @@ typedef struct {
     
     /** @brief Policy to apply when an overrun occurs. */
     cl_overrun_bh or_bh;
+
+    /** @brief Maximum back-to-back catch-up cycles (CL_OVERRUN_BH_CATCHUP_N only). */
+    unsigned or_catchup_max;
+
+    /** @brief Number of overruns that stops the task (CL_OVERRUN_BH_STOP_AFTER_K only). */
+    unsigned or_stop_limit;
+
+    /** @brief Sliding window in cycles for or_stop_limit. 0 counts consecutive overruns. */
+    unsigned or_stop_window;
     
     /** @brief Pointer to the CPU affinity mask (cpu_set_t). */
     cpu_set_t *cpu_mask;
@@ -93,16 +291,530 @@ typedef struct {
     /** @brief Size of the cpu_mask structure in bytes (use sizeof(cpu_set_t)). */
     size_t cpu_mask_size;
     
-    /** @brief Scheduling policy (e.g., SCHED_FIFO, SCHED_RR, SCHED_OTHER). */
+    /**
+     * @brief Scheduling policy (e.g., SCHED_FIFO, SCHED_RR, SCHED_OTHER, SCHED_DEADLINE).
+     *
+     * SCHED_DEADLINE reserves runtime_us every period_us through the kernel's
+     * CBS admission control, priority is ignored and each job ends with
+     * sched_yield() instead of wait_mode. The kernel only admits deadline
+     * tasks whose affinity spans their whole root domain, so pin them with an
+     * exclusive cpuset rather than a narrow cpu_mask.
+     */
     int sched_policy;
     
-    /** @brief Total duration in seconds after which the task stops. Use -1 for infinite. */
+    /**
+     * @brief Total duration in seconds after which the task stops. Use -1 for infinite.
+     *
+     * Converted to an exact number of cycles (rounded up) at creation, so
+     * overrun cycles count towards the duration as well.
+     */
     double stop_time;
     
     /** @brief Start time alignment in nanoseconds (e.g., 1e9 for 1s boundary). Use 0 for immediate start. */
     int start_align;
+
+    /** @brief Collect per-cycle timing statistics (see cl_inst_get_stats()). */
+    bool collect_stats;
+
+    /** @brief Strategy used to wait for the next period boundary. */
+    cl_wait_mode wait_mode;
+
+    /** @brief Busy-poll window before the deadline in microseconds (CL_WAIT_HYBRID only). */
+    size_t spin_margin_us;
+
+    /** @brief Time source used for deadline arithmetic inside the loop. */
+    cl_clock_source clock_source;
+
+    /**
+     * @brief Capacity of the asynchronous event ring (rounded up to a power of two).
+     *
+     * When non-zero, overrun and termination reports are queued into a
+     * lock-free ring instead of being printed from the real-time thread.
+     * Drain them with cl_inst_drain_events() or enable event_reporter.
+     */
+    size_t event_ring_size;
+
+    /**
+     * @brief Spawn a non-RT thread that drains the event ring and prints it to stderr.
+     *
+     * The reporter runs under SCHED_OTHER on the CPUs of the process outside
+     * cpu_mask, or where the caller runs if cpu_mask covers all of them.
+     */
+    bool event_reporter;
+
+    /**
+     * @brief Lock all current and future process memory with mlockall().
+     *
+     * Process-wide and never undone by the library.
+     */
+    bool lock_memory;
+
+    /** @brief Stack size of the real-time thread in bytes. Use 0 for the default. */
+    size_t stack_size;
+
+    /**
+     * @brief Bytes of the real-time thread stack to touch before the first cycle.
+     *
+     * cl_inst_create() fails unless 16 KiB of the stack (stack_size or the
+     * default thread stack) stay untouched on top.
+     */
+    size_t stack_prefault;
+
+    /** @brief Start of a user memory range (e.g. task data) to prefault before the first cycle. */
+    void *prefault_addr;
+
+    /** @brief Length of the prefault_addr range in bytes. */
+    size_t prefault_len;
+
+    /**
+     * @brief Check the RT thread page fault counters every N cycles. Use 0 to disable.
+     *
+     * Faults are accumulated in the stats and reported as CL_EVENT_PAGE_FAULTS.
+     */
+    unsigned fault_check_cycles;
+
+    /**
+     * @brief Number of unmeasured warm-up cycles run before the start time is latched.
+     *
+     * Warm-up cycles are paced by the period but never reach the overrun
+     * policy; their overruns are only counted (cl_stats_t.warmup_overruns).
+     * They run before start_align alignment, so the first measured cycle
+     * still starts on the aligned boundary.
+     */
+    unsigned warmup_cycles;
+
+    /**
+     * @brief Callback for warm-up cycles. NULL runs the regular task. Must be
+     * NULL for cl_exec_create(), whose warm-up runs the task schedule.
+     */
+    cl_task warmup_fn;
+
+    /** @brief Allocate the instance memory on the NUMA node of the first CPU in cpu_mask. */
+    bool numa_local;
+
+    /**
+     * @brief Release source of the loop.
+     *
+     * In event-driven modes period_us is the relative deadline of a cycle,
+     * measured from the trigger instant, and stop_time is ignored.
+     */
+    cl_trigger_mode trigger;
+
+    /** @brief File descriptor to wait on (CL_TRIGGER_FD only). */
+    int trigger_fd;
+
+    /** @brief Bytes read from trigger_fd per release: 8 for eventfd/timerfd, 4 for UIO. 0 means 8. */
+    size_t trigger_read_size;
+
+    /** @brief Memory flag to busy-poll (CL_TRIGGER_FLAG only), accessed atomically. */
+    int *trigger_flag;
+
+    /**
+     * @brief Reference clock for phase locking (periodic mode only).
+     *
+     * Every sync_interval_cycles the loop measures how far its current release
+     * is from the nearest multiple of the period on the reference clock and
+     * moves the next deadline towards it by at most sync_max_slew_ns. Loops
+     * with the same period on different nodes then release within the same
+     * window of the shared reference time.
+     */
+    cl_sync_source sync_source;
+
+    /** @brief PTP hardware clock device, e.g. "/dev/ptp0" (CL_SYNC_PHC only). */
+    const char *sync_phc_path;
+
+    /** @brief Cycles between two phase measurements. 0 means every 100 cycles. */
+    unsigned sync_interval_cycles;
+
+    /** @brief Bound of a single phase correction in ns. 0 means 1000 ns. */
+    size_t sync_max_slew_ns;
+
+    /** @brief CPU time reserved per period in microseconds (SCHED_DEADLINE only). */
+    size_t runtime_us;
+
+    /** @brief Relative deadline in microseconds, 0 means period_us (SCHED_DEADLINE only). */
+    size_t deadline_us;
+
+    /**
+     * @brief Entries of the per-cycle flight recorder, rounded up to a power of two. 0 disables it.
+     *
+     * The RT thread keeps the last trace_cycles cycles in a preallocated ring
+     * with plain stores. The ring is frozen on an overrun (trace_freeze_on_overrun),
+     * when the loop ends or by cl_inst_trace_dump(), and written to trace_path
+     * in the cl_trace_header_t format.
+     */
+    size_t trace_cycles;
+
+    /** @brief File the frozen flight recorder is dumped to, NULL for cl_inst_trace_dump() only. */
+    const char *trace_path;
+
+    /** @brief Freeze the flight recorder on the first overrun, keeping the cycles before it. */
+    bool trace_freeze_on_overrun;
+
+    /**
+     * @brief cl_core_check bits cl_inst_run() verifies on cpu_mask. 0 skips the check.
+     *
+     * Failed checks are reported on stderr; with core_strict the start is
+     * refused. Nothing is changed, use cl_core_prepare() to enforce.
+     */
+    unsigned core_require;
+
+    /** @brief Refuse to start when a core_require check fails. */
+    bool core_strict;
+
+    /**
+     * @brief Specialized loop generated by CL_DEFINE_LOOP(), NULL for the generic loop.
+     *
+     * The task argument of cl_inst_create() then only runs the warm-up.
+     * Specialized loops run on CLOCK_MONOTONIC and the trigger, sync,
+     * SCHED_DEADLINE, statistics, performance counter, flight recorder,
+     * fault check, watchdog, budget, status segment, per-cycle arena reset,
+     * malloc interposition and background job features are not available;
+     * cl_inst_create() rejects such attributes, and
+     * cl_inst_set_period()/cl_inst_set_priority() return CL_ERR_INVAL.
+     */
+    cl_loop_fn loop;
+
+    /**
+     * @brief Periods a task may run before the watchdog reacts, 0 disables supervision.
+     *
+     * The RT thread publishes a heartbeat around every task call and the
+     * supervisor started by cl_wdog_start() acts once per stall, within
+     * wdog_stall_periods periods plus one poll interval. Waiting for a
+     * trigger is not a stall.
+     */
+    unsigned wdog_stall_periods;
+
+    /** @brief cl_wdog_action bits applied to a stall. 0 means CL_WDOG_NOTIFY. */
+    unsigned wdog_actions;
+
+    /** @brief Notification callback of CL_WDOG_NOTIFY, NULL prints to stderr. */
+    cl_wdog_fn wdog_fn;
+
+    /** @brief User argument passed to wdog_fn. */
+    void *wdog_arg;
+
+    /**
+     * @brief Soft deadline in percent of the period (1-99), 0 disables it.
+     *
+     * A per-thread timer delivers budget_signal that far into each cycle
+     * while the task still runs, which sets cl_budget_expired() and calls
+     * budget_fn. Costs two timer_settime() calls per cycle.
+     */
+    unsigned budget_pct;
+
+    /** @brief Signal of the soft deadline timer, owned by the library. 0 means SIGRTMIN. */
+    int budget_signal;
+
+    /** @brief Optional hook run by the soft deadline signal handler. */
+    cl_budget_fn budget_fn;
+
+    /**
+     * @brief cl_pmc_event counters to sample around every task call (requires collect_stats).
+     *
+     * The counters are opened with perf_event_open() for the RT thread, user
+     * space only, and read with rdpmc when the kernel allows it
+     * (/sys/bus/event_source/devices/cpu/rdpmc), with read() otherwise.
+     * Counters the hardware or perf_event_paranoid refuse are left out, see
+     * cl_stats_t.pmc_events.
+     */
+    unsigned pmc_events;
+
+    /**
+     * @brief Name of the shared memory status segment /dev/shm/corelock.<name>, NULL for none.
+     *
+     * The RT thread publishes cycle count, state, configuration and, with
+     * collect_stats, the overrun and timing statistics into a cl_shm_status_t
+     * with plain stores under a seqlock. Other processes read it with
+     * cl_shm_attach()/cl_shm_read(). The segment is removed by cl_inst_destroy().
+     * cl_inst_create() fails if the name is used by another live instance. A
+     * segment left behind by a process that crashed, whose pid is gone, is
+     * reclaimed.
+     */
+    const char *shm_name;
+
+    /** @brief Interval of the shared memory updates in microseconds. 0 means 100 ms. */
+    size_t shm_interval_us;
+
+    /**
+     * @brief Size of the per-instance allocation arena in bytes, 0 for none.
+     *
+     * Allocated, faulted in and mlock()ed by cl_inst_create(), on the NUMA
+     * node of the instance with numa_local. Served by cl_arena_alloc() with
+     * bump-pointer semantics.
+     */
+    size_t arena_size;
+
+    /** @brief Rewind the arena before every cycle, so blocks live for one cycle. */
+    bool arena_reset_cycle;
+
+    /**
+     * @brief Route malloc() and friends of the task to the arena.
+     *
+     * Needs a library built with CORELOCK_MALLOC_HOOK, otherwise
+     * cl_inst_create() fails. Only allocations made while the task or a
+     * subtask runs are routed; free() of an arena block is a no-op and
+     * requests the arena cannot serve fall back to glibc and are counted.
+     * With arena_reset_cycle, memory allocated by the task must not be used
+     * after the cycle ends.
+     */
+    bool arena_interpose;
+
+    /**
+     * @brief Cleanup hook run on the RT thread when it leaves the loop, e.g.
+     * to drive outputs to a safe state. NULL for none.
+     */
+    cl_stop_fn on_stop;
+
+    /**
+     * @brief Stack of the background job slot in bytes, 0 disables it.
+     *
+     * At least PTHREAD_STACK_MIN; periodic, non-SCHED_DEADLINE instances
+     * only. The stack is preallocated and prefaulted at cl_inst_create().
+     */
+    size_t job_stack_size;
+
+    /** @brief Time before the next release a job slice must end by. 0 means 20 us. */
+    size_t job_margin_us;
 } cl_attr_t;
 
+/**
+ * @brief Types of events reported by the real-time thread.
+ */
+typedef enum {
+    /** @brief A cycle finished after its deadline. */
+    CL_EVENT_OVERRUN,
+    /** @brief An executor task finished after its own deadline. */
+    CL_EVENT_TASK_OVERRUN,
+    /** @brief The overrun policy requested the task to stop. */
+    CL_EVENT_TERMINATE,
+    /** @brief The RT thread took page faults since the previous check. */
+    CL_EVENT_PAGE_FAULTS,
+    /** @brief The task reached its stop_time. */
+    CL_EVENT_FINISHED,
+} cl_event_type;
+
+/**
+ * @brief Event record queued by the real-time thread.
+ */
+typedef struct {
+    /** @brief Kind of the event. */
+    cl_event_type type;
+    /** @brief Index of the executor task (CL_EVENT_TASK_OVERRUN only). */
+    size_t task_index;
+    /** @brief Cycle (or executor frame) index the event belongs to. */
+    unsigned long long cycle;
+    /** @brief CLOCK_MONOTONIC time of the event in nanoseconds. */
+    unsigned long long timestamp_ns;
+    /**
+     * @brief Event payload: lateness in ns for overruns, total run duration in
+     * ns for CL_EVENT_FINISHED, number of faults for CL_EVENT_PAGE_FAULTS.
+     */
+    long long value;
+} cl_event_t;
+
+/** @brief Magic of a flight recorder dump, followed by the format version. */
+#define CL_TRACE_MAGIC "CLTRACE"
+#define CL_TRACE_VERSION 1
+
+/**
+ * @brief Header of a flight recorder dump file.
+ *
+ * The header is followed by @c count cl_trace_rec_t records, oldest first.
+ * Fields are in host byte order.
+ */
+typedef struct {
+    /** @brief CL_TRACE_MAGIC, NUL terminated. */
+    char magic[8];
+    /** @brief CL_TRACE_VERSION. */
+    uint32_t version;
+    /** @brief sizeof(cl_trace_rec_t) of the writer. */
+    uint32_t rec_size;
+    /** @brief Number of records that follow. */
+    uint64_t count;
+    /** @brief Period at the time of the dump in nanoseconds. */
+    uint64_t period_ns;
+    /** @brief CLOCK_MONOTONIC start time of the loop in nanoseconds. */
+    uint64_t start_ns;
+} cl_trace_header_t;
+
+/**
+ * @brief One cycle of the flight recorder. Times are CLOCK_MONOTONIC ns.
+ */
+typedef struct {
+    /** @brief Cycle index. */
+    uint64_t cycle;
+    /** @brief Scheduled release of the cycle. */
+    uint64_t release_ns;
+    /** @brief Wakeup, which is also the start of the task. */
+    uint64_t wake_ns;
+    /** @brief End of the task. */
+    uint64_t end_ns;
+    /** @brief Value returned by the task. */
+    int64_t ret;
+} cl_trace_rec_t;
+
+/** @brief Magic of a shared memory status segment, followed by the layout version. */
+#define CL_SHM_MAGIC "CLSTAT"
+#define CL_SHM_VERSION 1
+
+/**
+ * @brief Life cycle of an instance as seen in its status segment.
+ */
+typedef enum {
+    /** @brief Created, cl_inst_run() not called or the thread not started yet. */
+    CL_SHM_CREATED,
+    /** @brief The loop runs. */
+    CL_SHM_RUNNING,
+    /** @brief The loop has ended. */
+    CL_SHM_FINISHED,
+} cl_shm_state;
+
+/**
+ * @brief Layout of a shared memory status segment (cl_attr_t.shm_name).
+ *
+ * Fixed-width fields in host byte order. @c seq is odd while the RT thread
+ * updates the segment; use cl_shm_read() for a consistent copy. Timing
+ * fields stay 0 unless the instance collects statistics.
+ */
+typedef struct {
+    /** @brief CL_SHM_MAGIC, NUL terminated. */
+    char magic[8];
+    /** @brief CL_SHM_VERSION. */
+    uint32_t version;
+    /** @brief sizeof(cl_shm_status_t) of the writer. */
+    uint32_t size;
+    /** @brief Seqlock sequence, odd during an update. */
+    uint32_t seq;
+    /** @brief cl_shm_state. */
+    uint32_t state;
+    /** @brief Process of the instance. */
+    int32_t pid;
+    /** @brief First CPU of the affinity mask, -1 if none. */
+    int32_t cpu;
+    /** @brief Current period in microseconds. */
+    uint64_t period_us;
+    /** @brief Current priority and scheduling policy. */
+    int32_t priority;
+    int32_t sched_policy;
+    /** @brief cl_overrun_bh and cl_wait_mode of the instance. */
+    uint32_t or_bh;
+    uint32_t wait_mode;
+    /** @brief CLOCK_MONOTONIC time of the last update in nanoseconds. */
+    uint64_t update_ns;
+    /** @brief Completed cycles. */
+    uint64_t cycle;
+    /** @brief Overruns and skipped periods (statistics only). */
+    uint64_t overruns;
+    uint64_t skipped_periods;
+    /** @brief Wakeup latency, execution time and slack in ns (statistics only). */
+    int64_t latency_min_ns;
+    int64_t latency_mean_ns;
+    int64_t latency_max_ns;
+    int64_t exec_min_ns;
+    int64_t exec_mean_ns;
+    int64_t exec_max_ns;
+    int64_t slack_min_ns;
+    int64_t slack_mean_ns;
+    int64_t slack_max_ns;
+} cl_shm_status_t;
+
+/** @brief Number of log2 buckets in the wakeup latency histogram. */
+#define CL_STATS_HIST_BUCKETS 32
+
+/**
+ * @brief Min/max/mean summary of a per-cycle timing quantity.
+ */
+typedef struct {
+    /** @brief Smallest observed value in nanoseconds. */
+    long long min_ns;
+    /** @brief Largest observed value in nanoseconds. */
+    long long max_ns;
+    /** @brief Arithmetic mean over all recorded cycles in nanoseconds. */
+    long long mean_ns;
+} cl_stat_t;
+
+/**
+ * @brief Aggregated per-cycle counts of one performance counter.
+ */
+typedef struct {
+    /** @brief Minimal count in a cycle. */
+    long long min;
+    /** @brief Maximal count in a cycle. */
+    long long max;
+    /** @brief Average count per cycle. */
+    long long mean;
+} cl_pmc_stat_t;
+
+/**
+ * @brief Snapshot of the timing statistics of a CoreLock instance.
+ *
+ * Collected by the real-time thread when cl_attr_t.collect_stats is set.
+ * All values are measured against CLOCK_MONOTONIC.
+ */
+typedef struct {
+    /** @brief Number of completed cycles. */
+    unsigned long long cycles;
+
+    /** @brief Number of cycles that finished after their deadline. */
+    unsigned long long overruns;
+
+    /** @brief Periods skipped by CL_OVERRUN_BH_SKIP / CL_OVERRUN_BH_CATCHUP_N realignment. */
+    unsigned long long skipped_periods;
+
+    /** @brief Overruns that happened during the warm-up cycles. */
+    unsigned long long warmup_overruns;
+
+    /** @brief Last measured phase offset from the reference clock grid (cl_attr_t.sync_source only). */
+    long long sync_offset_ns;
+
+    /** @brief Minor page faults in the loop (cl_attr_t.fault_check_cycles only). */
+    unsigned long long minor_faults;
+
+    /** @brief Major page faults in the loop (cl_attr_t.fault_check_cycles only). */
+    unsigned long long major_faults;
+
+    /** @brief Actual wakeup time minus the scheduled release time. */
+    cl_stat_t wakeup_latency;
+
+    /** @brief Time spent inside the task callback and the subtasks due in the cycle. */
+    cl_stat_t exec_time;
+
+    /** @brief Time left before the deadline after the task returned (negative on overrun). */
+    cl_stat_t slack;
+
+    /**
+     * @brief Wakeup latency histogram.
+     *
+     * Bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds. Bucket 0 also
+     * counts non-positive latencies, the last bucket is open-ended.
+     */
+    unsigned long long latency_hist[CL_STATS_HIST_BUCKETS];
+
+    /** @brief cl_pmc_event counters that could be opened, a subset of cl_attr_t.pmc_events. */
+    unsigned pmc_events;
+
+    /** @brief Counts of the task and subtasks per cycle, indexed by cl_pmc_event bit position. */
+    cl_pmc_stat_t pmc[CL_PMC_COUNT];
+} cl_stats_t;
+
+/** @brief Lets cl_inst_add_subtask() choose the phase that flattens the per-cycle load. */
+#define CL_SUBTASK_PHASE_AUTO ((unsigned)-1)
+
+/**
+ * @brief Per-subtask statistics, see cl_inst_get_subtask_stats().
+ */
+typedef struct {
+    /** @brief Phase in use, resolved for CL_SUBTASK_PHASE_AUTO once the instance runs. */
+    unsigned phase;
+
+    /** @brief Number of executions. */
+    unsigned long long runs;
+
+    /** @brief Time spent inside the subtask. */
+    cl_stat_t exec_time;
+} cl_subtask_stats_t;
+
 /**
  * @brief Macro helper to initialize default attributes for a CoreLock task.
  * 
@@ -120,7 +832,54 @@ typedef struct {
    .or_bh = CL_OVERRUN_BH_STOP,                                                \
    .sched_policy = SCHED_FIFO,                                                 \
    .stop_time = -1,                                                            \
-   .start_align = 0}
+   .start_align = 0,                                                           \
+   .collect_stats = false,                                                     \
+   .wait_mode = CL_WAIT_SLEEP,                                                 \
+   .spin_margin_us = 0,                                                        \
+   .clock_source = CL_CLOCK_MONOTONIC,                                         \
+   .event_ring_size = 0,                                                       \
+   .event_reporter = false,                                                    \
+   .lock_memory = false,                                                       \
+   .stack_size = 0,                                                            \
+   .stack_prefault = 0,                                                        \
+   .prefault_addr = NULL,                                                      \
+   .prefault_len = 0,                                                          \
+   .fault_check_cycles = 0,                                                    \
+   .warmup_cycles = 0,                                                         \
+   .warmup_fn = NULL,                                                          \
+   .numa_local = false,                                                        \
+   .trigger = CL_TRIGGER_PERIODIC,                                             \
+   .trigger_fd = -1,                                                           \
+   .trigger_read_size = 0,                                                     \
+   .trigger_flag = NULL,                                                       \
+   .sync_source = CL_SYNC_NONE,                                                \
+   .sync_phc_path = NULL,                                                      \
+   .sync_interval_cycles = 0,                                                  \
+   .sync_max_slew_ns = 0,                                                      \
+   .runtime_us = 0,                                                            \
+   .deadline_us = 0,                                                           \
+   .trace_cycles = 0,                                                          \
+   .trace_path = NULL,                                                         \
+   .trace_freeze_on_overrun = false,                                           \
+   .core_require = 0,                                                          \
+   .core_strict = false,                                                       \
+   .loop = NULL,                                                               \
+   .wdog_stall_periods = 0,                                                    \
+   .wdog_actions = 0,                                                          \
+   .wdog_fn = NULL,                                                            \
+   .wdog_arg = NULL,                                                           \
+   .budget_pct = 0,                                                            \
+   .budget_signal = 0,                                                         \
+   .budget_fn = NULL,                                                          \
+   .pmc_events = 0,                                                            \
+   .shm_name = NULL,                                                           \
+   .shm_interval_us = 0,                                                       \
+   .arena_size = 0,                                                            \
+   .arena_reset_cycle = false,                                                 \
+   .arena_interpose = false,                                                   \
+   .on_stop = NULL,                                                            \
+   .job_stack_size = 0,                                                        \
+   .job_margin_us = 0}
 
 /**
  * @brief Creates and initializes a new CoreLock task instance.
@@ -133,7 +892,10 @@ typedef struct {
  * @param arg User-defined argument passed to the task.
  * @param attrs Configuration structure (period, priority, affinity, etc.).
  * @return struct cl_instanse_s* Pointer to the initialized instance, or NULL on
- * allocation failure.
+ * allocation failure, if the requested clock source is not available, if
+ * the overrun policy, stack, trigger, sync, deadline, budget or performance
+ * counter parameters are invalid, if the PTP clock or the status segment
+ * cannot be opened, if the arena cannot be locked or if mlockall() fails.
  */
 struct cl_instanse_s *cl_inst_create(cl_task task, void *arg,
                                      const cl_attr_t *attrs);
@@ -143,18 +905,49 @@ struct cl_instanse_s *cl_inst_create(cl_task task, void *arg,
  *
  * @param inst Pointer to the initialized CoreLock instance.
  * @return [[nodiscard]] CL_OK on success, CL_ERR_START if thread creation
- * fails.
+ * fails or a cl_attr_t.core_require check fails with core_strict set.
  */
 cl_status_t cl_inst_run(struct cl_instanse_s *inst);
 
+/**
+ * @brief Changes the task period without restarting the thread.
+ *
+ * The new period is published atomically and picked up by the RT thread at
+ * the next cycle boundary: the next deadline becomes the release time of that
+ * cycle plus the new period, so the phase of the loop is kept. A remaining
+ * stop_time is rescaled to the new period. Wait-free for the caller.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param period_us New period in microseconds.
+ * @return CL_OK on success, CL_ERR_INVAL if the period is zero or, for
+ *         SCHED_DEADLINE, shorter than the reserved runtime or deadline, or
+ *         if the instance runs a specialized loop.
+ */
+cl_status_t cl_inst_set_period(struct cl_instanse_s *inst, size_t period_us);
+
+/**
+ * @brief Changes the real-time priority without restarting the thread.
+ *
+ * Applied by the RT thread itself at the next cycle boundary.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param priority New priority, valid for the instance scheduling policy.
+ * @return CL_OK on success, CL_ERR_INVAL if the priority is out of range or
+ *         the instance runs under SCHED_DEADLINE or a specialized loop.
+ */
+cl_status_t cl_inst_set_priority(struct cl_instanse_s *inst, int priority);
+
 /**
  * @brief Signals a running task to stop gracefully.
  *
- * Sets the internal stop flag using atomic release semantics. The task will
- * finish its current iteration before exiting the loop.
+ * Sets the internal stop flag using atomic release semantics and wakes the
+ * thread if it sleeps until the next release or waits for its trigger fd, so
+ * the stop takes effect once the current task returns instead of after a full
+ * period. A SCHED_DEADLINE instance yielding its reservation is only seen at
+ * its next release. on_stop runs on the RT thread before the thread exits.
  *
  * @param inst Pointer to the CoreLock instance.
- * @return CL_OK on success.
+ * @return CL_OK on success, CL_ERR_IO if the trigger wait could not be woken.
  */
 cl_status_t cl_inst_stop(struct cl_instanse_s *inst);
 
@@ -168,24 +961,263 @@ cl_status_t cl_inst_stop(struct cl_instanse_s *inst);
  */
 bool cl_inst_is_stopped(struct cl_instanse_s *inst);
 
+/**
+ * @brief Reads a consistent snapshot of the instance timing statistics.
+ *
+ * Lock-free with respect to the real-time thread: the snapshot is taken under
+ * a sequence lock, so the reader retries instead of blocking the writer.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param stats [out] Destination for the snapshot.
+ * @return CL_OK on success, CL_ERR_INVAL if statistics are not enabled.
+ */
+cl_status_t cl_inst_get_stats(struct cl_instanse_s *inst, cl_stats_t *stats);
+
+/**
+ * @brief Appends a subtask to the chain run after the task of the instance.
+ *
+ * The subtask runs in cycles where cycle % @p divisor == @p phase, after the
+ * main task and the subtasks registered before it. A non-zero return value
+ * ends the loop like one of the task. With CL_SUBTASK_PHASE_AUTO the phase is
+ * chosen when the instance starts so that runs of the automatically placed
+ * subtasks land on the least loaded cycles, counting every run as one unit.
+ *
+ * @param inst Pointer to an instance that has not been started.
+ * @param fn Subtask function.
+ * @param arg Argument of @p fn.
+ * @param divisor Rate divisor relative to period_us (1 = every cycle).
+ * @param phase Cycle offset below @p divisor, or CL_SUBTASK_PHASE_AUTO.
+ * @return CL_OK on success, CL_ERR_BUSY if the instance was started,
+ *         CL_ERR_INVAL on a bad divisor or phase or for a specialized loop,
+ *         CL_ERR_NOMEM if the chain cannot grow.
+ */
+cl_status_t cl_inst_add_subtask(struct cl_instanse_s *inst, cl_task fn,
+                                void *arg, unsigned divisor, unsigned phase);
+
+/**
+ * @brief Reads the statistics of one subtask, in the same way as cl_inst_get_stats().
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param index Registration index of the subtask.
+ * @param stats [out] Destination for the snapshot.
+ * @return CL_OK on success, CL_ERR_INVAL if statistics are not enabled or
+ *         @p index is out of range.
+ */
+cl_status_t cl_inst_get_subtask_stats(struct cl_instanse_s *inst, size_t index,
+                                      cl_subtask_stats_t *stats);
+
+/**
+ * @brief Maps the status segment of an instance, possibly of another process.
+ *
+ * Read-only; needs no privileges beyond the segment permissions (0644).
+ *
+ * @param name cl_attr_t.shm_name of the instance.
+ * @param seg [out] Mapped segment.
+ * @return CL_OK on success, CL_ERR_IO if the segment cannot be opened,
+ *         CL_ERR_INVAL if it is not a CL_SHM_VERSION status segment.
+ */
+cl_status_t cl_shm_attach(const char *name, const cl_shm_status_t **seg);
+
+/**
+ * @brief Copies a consistent snapshot of a mapped status segment.
+ *
+ * Lock-free for both sides: retries while the RT thread is updating.
+ *
+ * @param seg Segment returned by cl_shm_attach().
+ * @param out [out] Snapshot.
+ * @return CL_OK on success, CL_ERR_BUSY if no consistent copy was taken
+ *         within a bounded number of retries.
+ */
+cl_status_t cl_shm_read(const cl_shm_status_t *seg, cl_shm_status_t *out);
+
+/**
+ * @brief Unmaps a segment returned by cl_shm_attach().
+ */
+void cl_shm_detach(const cl_shm_status_t *seg);
+
+/**
+ * @brief Usage of an instance arena.
+ */
+typedef struct {
+    /** @brief Arena size in bytes (cl_attr_t.arena_size). */
+    size_t size;
+    /** @brief Highest fill level since the start in bytes. */
+    size_t peak;
+    /** @brief Allocations the arena could not serve. */
+    unsigned long long fallbacks;
+} cl_arena_info_t;
+
+/**
+ * @brief Allocates from the arena of the instance, 16-byte aligned.
+ *
+ * Constant time with no syscall or lock. Call from the RT thread only.
+ *
+ * @param inst Instance of the calling task.
+ * @param size Bytes to allocate.
+ * @return Pointer to the block, NULL if the arena is full or absent.
+ */
+void *cl_arena_alloc(struct cl_instanse_s *inst, size_t size);
+
+/**
+ * @brief Releases every arena block at once. Call from the RT thread only.
+ *
+ * @param inst Instance of the calling task.
+ */
+void cl_arena_reset(struct cl_instanse_s *inst);
+
+/**
+ * @brief Reads the usage of the arena, from any thread.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param info [out] Arena usage.
+ * @return CL_OK on success, CL_ERR_INVAL if the instance has no arena.
+ */
+cl_status_t cl_inst_get_arena_info(struct cl_instanse_s *inst,
+                                   cl_arena_info_t *info);
+
+/**
+ * @brief Returns the instance whose RT thread is calling, NULL on other threads.
+ */
+struct cl_instanse_s *cl_inst_self(void);
+
+/**
+ * @brief Time left until the deadline of the current cycle.
+ *
+ * Meant for anytime algorithms in the task: one clock read, no syscall for
+ * the default clock source or the CPU counter. Only valid on the RT thread
+ * of a generic loop.
+ *
+ * @param inst Instance of the calling task, e.g. cl_inst_self().
+ * @return Nanoseconds until the deadline, negative once it has passed.
+ */
+long long cl_remaining_ns(struct cl_instanse_s *inst);
+
+/**
+ * @brief Tells whether the soft deadline (budget_pct) of the current cycle passed.
+ *
+ * A single relaxed load, cheap enough for the inner loop of a solver.
+ *
+ * @param inst Instance of the calling task.
+ * @return true once the soft deadline timer fired in this cycle.
+ */
+bool cl_budget_expired(struct cl_instanse_s *inst);
+
+/**
+ * @brief Hands a job to the background slot of the instance.
+ *
+ * The RT thread runs the job on its own stack (job_stack_size) after the task
+ * of a cycle returns, in the slack up to job_margin_us before the next
+ * release, and resumes it where it yielded in the next cycles until it
+ * returns. It never delays a release as long as it calls cl_job_yield() more
+ * often than every job_margin_us. May be called from any thread, including
+ * the task. A job still running when the loop stops is abandoned, so it must
+ * not keep resources it cannot lose across a yield.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param fn Job function.
+ * @param arg Argument passed to @p fn.
+ * @return CL_OK on success, CL_ERR_INVAL if the instance has no job slot,
+ * CL_ERR_BUSY if a job is already pending or running.
+ */
+cl_status_t cl_inst_submit_job(struct cl_instanse_s *inst, cl_job_fn fn,
+                               void *arg);
+
+/**
+ * @brief Checks if the job slot still holds a submitted job.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @return true from cl_inst_submit_job() until the job returns.
+ */
+bool cl_inst_job_busy(struct cl_instanse_s *inst);
+
+/**
+ * @brief Yield point of a background job.
+ *
+ * Switches back to the RT loop if the slice of this cycle is used up or the
+ * instance is stopping, and returns in a later cycle; otherwise returns at
+ * once after one clock read. A no-op outside of a job.
+ */
+void cl_job_yield(void);
+
+/**
+ * @brief Moves queued events out of the asynchronous event ring.
+ *
+ * Single consumer: must not be used together with cl_attr_t.event_reporter
+ * or from several threads at once. Never blocks the real-time thread.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param events [out] Destination array.
+ * @param max Capacity of @p events.
+ * @return size_t Number of events written, 0 if the ring is empty or disabled.
+ */
+size_t cl_inst_drain_events(struct cl_instanse_s *inst, cl_event_t *events,
+                            size_t max);
+
+/**
+ * @brief Returns the number of events lost because the ring was full.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @return unsigned long long Number of dropped events.
+ */
+unsigned long long cl_inst_events_dropped(struct cl_instanse_s *inst);
+
+/**
+ * @brief Freezes the flight recorder and writes it to a file.
+ *
+ * Can be called while the task runs; recording stays frozen until
+ * cl_inst_trace_resume(). The cycle being recorded concurrently is left out.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param path Destination file, NULL for cl_attr_t.trace_path.
+ * @return CL_OK on success, CL_ERR_INVAL if the recorder is disabled or no
+ *         path is given, CL_ERR_NOMEM or CL_ERR_IO if the dump failed.
+ */
+cl_status_t cl_inst_trace_dump(struct cl_instanse_s *inst, const char *path);
+
+/**
+ * @brief Restarts recording after a freeze.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @return CL_OK on success, CL_ERR_INVAL if the recorder is disabled.
+ */
+cl_status_t cl_inst_trace_resume(struct cl_instanse_s *inst);
+
 /**
  * @brief Waits for the task thread to terminate and retrieves its return value.
  *
  * Standard blocking join operation. This must be called before
- * cl_inst_destroy().
+ * cl_inst_destroy(). A flight recorder with a trace_path that was not
+ * dumped yet is written out here.
  *
  * @param inst Pointer to the CoreLock instance.
  * @param ret [out] Pointer to store the long value returned by the task
- * function.
+ * function, or CL_ERR_START if the kernel refused the SCHED_DEADLINE
+ * reservation.
  * @return CL_OK on success, CL_ERR_JOIN if pthread_join fails.
  */
 cl_status_t cl_inst_join(struct cl_instanse_s *inst, long *ret);
 
+/**
+ * @brief cl_inst_join() that gives up after @p timeout_us.
+ *
+ * Meant to follow cl_inst_stop(): a supervisor bounds its shutdown by the
+ * rest of the running task and on_stop instead of by the period.
+ *
+ * @param inst Pointer to the CoreLock instance.
+ * @param timeout_us Time to wait for the thread, in microseconds.
+ * @param ret [out] As for cl_inst_join().
+ * @return CL_OK once joined, CL_ERR_BUSY if the thread is still running after
+ * the timeout (the instance stays joinable), CL_ERR_JOIN on failure.
+ */
+cl_status_t cl_inst_join_timeout(struct cl_instanse_s *inst, size_t timeout_us,
+                                 long *ret);
+
 /**
  * @brief Forcefully terminates the task thread.
  *
  * Uses pthread_cancel() to kill the thread. Warning: this may leave resources
  * in an inconsistent state if the task does not have cancellation points.
+ * on_stop still runs; prefer cl_inst_stop() with cl_inst_join_timeout().
  *
  * @param inst Pointer to the CoreLock instance.
  * @return CL_OK on success, CL_ERR_TERM on failure.
@@ -204,6 +1236,650 @@ cl_status_t cl_inst_term(struct cl_instanse_s *inst);
  */
 cl_status_t cl_inst_destroy(struct cl_instanse_s *inst);
 
+/**
+ * @brief State shared between the library and a specialized loop.
+ *
+ * Filled by the RT thread once the start time is latched; the loop owns it
+ * until it returns.
+ */
+struct cl_loop_s {
+    /** @brief Owning instance, for the cl_loop_*() slow paths. */
+    struct cl_instanse_s *inst;
+    /** @brief Task argument given to cl_inst_create(). */
+    void *arg;
+    /** @brief Stop flag of the instance, read with acquire semantics. */
+    const volatile int *stop;
+    /** @brief Release of the first cycle, CLOCK_MONOTONIC ns. */
+    uint64_t start_ns;
+    uint64_t period_ns;
+    uint64_t spin_margin_ns;
+    /** @brief Elapsed periods (cycles + skipped) after which the loop ends, UINT64_MAX for none. */
+    uint64_t end_cycle;
+    /** @brief Completed cycles, kept up to date by the loop. */
+    uint64_t cycle;
+    /** @brief Periods skipped by CL_OVERRUN_BH_SKIP. */
+    uint64_t skipped;
+};
+
+/** @brief Reports an overrun of the current cycle (CL_EVENT_OVERRUN). Slow path. */
+void cl_loop_overrun(cl_loop_t *ctx, uint64_t now_ns, uint64_t deadline_ns);
+
+/** @brief Reports CL_EVENT_TERMINATE and raises the stop flag. Slow path. */
+void cl_loop_terminate(cl_loop_t *ctx, uint64_t now_ns);
+
+/** @brief Sleeps until @p ns (CLOCK_MONOTONIC) or until cl_inst_stop(). */
+void cl_loop_sleep(cl_loop_t *ctx, uint64_t ns);
+
+/** @brief Reports CL_EVENT_FINISHED for a loop that reached its stop_time. */
+void cl_loop_finished(cl_loop_t *ctx, uint64_t now_ns, uint64_t next_ns);
+
+#if defined(__cplusplus)
+#define CL_STATIC_ASSERT(cond, msg) static_assert(cond, msg)
+#else
+#define CL_STATIC_ASSERT(cond, msg) _Static_assert(cond, msg)
+#endif
+
+/** @brief Spin-wait hint (pause / yield) that leaves the SMT sibling its share. */
+static inline void cl_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+static inline uint64_t cl_loop_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Body of a specialized loop. Always inlined into the CL_DEFINE_LOOP()
+ * wrapper, so task, policy and wait mode are constants: the task call is
+ * direct (and inlinable), and the handling of other policies and wait modes
+ * folds away.
+ */
+__attribute__((always_inline)) static inline long
+cl_loop_body(cl_loop_t *ctx, cl_task task, cl_overrun_bh policy,
+             cl_wait_mode wait_mode) {
+    uint64_t next = ctx->start_ns, now, missed;
+    long res;
+
+    while (!__atomic_load_n(ctx->stop, __ATOMIC_ACQUIRE)) {
+        next += ctx->period_ns;
+        res = task(ctx->arg);
+        if (res)
+            return res;
+        now = cl_loop_now_ns();
+        if (now > next) {
+            if (policy == CL_OVERRUN_BH_NOTIFY || policy == CL_OVERRUN_BH_STOP)
+                cl_loop_overrun(ctx, now, next);
+            if (policy == CL_OVERRUN_BH_STOP) {
+                cl_loop_terminate(ctx, now);
+                ctx->cycle++;
+                return 0;
+            }
+            if (policy == CL_OVERRUN_BH_SKIP) {
+                missed = (now - next) / ctx->period_ns + 1;
+                next += missed * ctx->period_ns;
+                ctx->skipped += missed;
+            }
+        }
+        if (++ctx->cycle + ctx->skipped >= ctx->end_cycle) {
+            cl_loop_finished(ctx, now, next);
+            return 0;
+        }
+        if (now >= next)
+            continue;
+        if (wait_mode == CL_WAIT_SLEEP)
+            cl_loop_sleep(ctx, next);
+        if (wait_mode == CL_WAIT_HYBRID)
+            cl_loop_sleep(ctx, next - ctx->spin_margin_ns);
+        if (wait_mode != CL_WAIT_SLEEP)
+            while (cl_loop_now_ns() < next &&
+                   !__atomic_load_n(ctx->stop, __ATOMIC_RELAXED))
+                cl_cpu_relax();
+    }
+    return 0;
+}
+
+/**
+ * @brief Defines @p name, a cl_loop_fn specialized for one task.
+ *
+ * Assign it to cl_attr_t.loop; the instance lifecycle (cl_inst_run(),
+ * cl_inst_stop(), cl_inst_join(), events) stays the same. @p policy must be
+ * CL_OVERRUN_BH_IGNORE, _NOTIFY, _STOP or _SKIP and @p wait_mode a
+ * cl_wait_mode constant.
+ *
+ * @code
+ * static long step(void *arg) { ... }
+ * CL_DEFINE_LOOP(step_loop, step, CL_OVERRUN_BH_NOTIFY, CL_WAIT_HYBRID)
+ * ...
+ * attrs.loop = step_loop;
+ * @endcode
+ */
+#define CL_DEFINE_LOOP(name, task_fn, policy, wait_mode)                       \
+  CL_STATIC_ASSERT((policy) == CL_OVERRUN_BH_IGNORE ||                         \
+                       (policy) == CL_OVERRUN_BH_NOTIFY ||                     \
+                       (policy) == CL_OVERRUN_BH_STOP ||                       \
+                       (policy) == CL_OVERRUN_BH_SKIP,                         \
+                   "CL_DEFINE_LOOP supports IGNORE, NOTIFY, STOP and SKIP");   \
+  static long name(cl_loop_t *ctx) {                                           \
+    return cl_loop_body(ctx, task_fn, policy, wait_mode);                      \
+  }
+
+/**
+ * @brief Outcome of cl_core_prepare().
+ */
+typedef struct {
+    /** @brief Checked cl_core_check bits that still fail. */
+    unsigned issues;
+    /** @brief cl_core_check bits that were failing and got fixed. */
+    unsigned fixed;
+    /** @brief IRQs moved off the cores. */
+    unsigned irqs_moved;
+    /** @brief IRQs left on the cores (per-CPU, managed or no other CPU online). */
+    unsigned irqs_pinned;
+    /**
+     * @brief Open /dev/cpu_dma_latency request, -1 if none. The C-state limit
+     * holds while it stays open, see cl_core_release().
+     */
+    int dma_latency_fd;
+} cl_core_report_t;
+
+/**
+ * @brief Inspects and optionally quiets the cores in @p mask.
+ *
+ * isolcpus, nohz_full and rcu_nocbs are boot parameters and are only
+ * reported. For the enforceable checks the movable IRQs (and the default
+ * IRQ affinity) are moved to the online CPUs outside @p mask, the cpufreq
+ * governor is set to "performance" and a 0 us /dev/cpu_dma_latency request
+ * is held open. Requires root for enforcement.
+ *
+ * @param mask Cores that will run RT threads.
+ * @param mask_size Size of @p mask in bytes.
+ * @param check cl_core_check bits to inspect.
+ * @param enforce cl_core_check bits to fix when they fail (subset of @p check).
+ * @param report [out] What was found, fixed and left over.
+ * @return CL_OK if all checked bits pass, CL_ERR_BUSY if some still fail,
+ *         CL_ERR_INVAL if @p mask is empty.
+ */
+cl_status_t cl_core_prepare(const cpu_set_t *mask, size_t mask_size,
+                            unsigned check, unsigned enforce,
+                            cl_core_report_t *report);
+
+/**
+ * @brief Drops the C-state limit held by a report. IRQ and governor changes stay.
+ *
+ * @param report Report filled by cl_core_prepare().
+ */
+void cl_core_release(cl_core_report_t *report);
+
+/**
+ * @brief Attributes of the process-wide watchdog supervisor.
+ */
+typedef struct {
+    /** @brief Housekeeping cores of the supervisor thread, NULL for no affinity. */
+    cpu_set_t *cpu_mask;
+    /** @brief Size of cpu_mask in bytes. */
+    size_t cpu_mask_size;
+    /** @brief Scheduling policy of the supervisor (SCHED_OTHER, SCHED_FIFO, SCHED_RR). */
+    int sched_policy;
+    /** @brief Priority of the supervisor, above the supervised tasks when it shares their cores. */
+    int priority;
+    /** @brief Poll interval in microseconds. 0 means 1000 us. */
+    size_t poll_us;
+    /** @brief Hardware watchdog device, e.g. "/dev/watchdog". NULL for none. */
+    const char *hw_path;
+    /** @brief Hardware watchdog timeout in seconds. 0 keeps the device default. */
+    unsigned hw_timeout_s;
+} cl_wdog_attr_t;
+
+/**
+ * @brief Starts the watchdog supervisor thread of the process.
+ *
+ * Instances with wdog_stall_periods set are supervised from cl_inst_run()
+ * to cl_inst_join(). With hw_path the device is fed on every poll unless
+ * an instance with CL_WDOG_HW is stalled, so a hang that no other action
+ * resolves ends in a hardware reset after the device timeout.
+ *
+ * @param attrs Supervisor attributes.
+ * @return CL_OK on success, CL_ERR_BUSY if it already runs, CL_ERR_IO if the
+ *         hardware watchdog cannot be opened, CL_ERR_START if the thread
+ *         cannot be created.
+ */
+cl_status_t cl_wdog_start(const cl_wdog_attr_t *attrs);
+
+/**
+ * @brief Stops the supervisor thread and disarms the hardware watchdog.
+ *
+ * The device is closed with the magic 'V', which disarms it unless the
+ * driver runs with nowayout.
+ *
+ * @return CL_OK on success, CL_ERR_INVAL if the supervisor does not run.
+ */
+cl_status_t cl_wdog_stop(void);
+
+/**
+ * @brief Opaque handle to a CoreLock multi-task executor.
+ *
+ * An executor owns a single real-time thread and runs several periodic tasks
+ * in it as a cyclic executive. The minor frame is the greatest common divisor
+ * of the task periods; within a frame the released tasks run in
+ * rate-monotonic order (shortest period first).
+ */
+struct cl_executor_s;
+
+/**
+ * @brief Creates a new, empty executor.
+ *
+ * All thread-level attributes (affinity, scheduler, priority, stop_time,
+ * start_align, collect_stats) are taken from @p attrs. The period is
+ * ignored and derived from the added tasks. The overrun policy applies to the
+ * minor frame as a whole, so a frame that runs a long task past the minor
+ * period is an overrun; CL_OVERRUN_BH_IGNORE leaves the checks to the
+ * per-task policies. Warm-up frames (warmup_cycles) run the task schedule
+ * without overrun checks, and the measured schedule then starts over from
+ * frame 0.
+ *
+ * @param attrs Thread configuration of the executor.
+ * @return struct cl_executor_s* Pointer to the executor, or NULL on
+ * allocation failure or if @p attrs sets a warmup_fn or one of the
+ * realigning policies CL_OVERRUN_BH_SKIP and CL_OVERRUN_BH_CATCHUP_N, which
+ * would drop frames from the task schedule.
+ */
+struct cl_executor_s *cl_exec_create(const cl_attr_t *attrs);
+
+/**
+ * @brief Registers a periodic task in the executor.
+ *
+ * Only cl_attr_t.period_us, cl_attr_t.or_bh and cl_attr_t.or_stop_limit are
+ * used from @p attrs. An overrun is detected when the task returns after its
+ * own deadline (release time plus its period). CL_OVERRUN_BH_STOP stops the
+ * executor as a whole, CL_OVERRUN_BH_STOP_AFTER_K does so after
+ * or_stop_limit consecutive overruns of the task. The frame timeline is
+ * shared by all tasks, so CL_OVERRUN_BH_SKIP and CL_OVERRUN_BH_CATCHUP_N are
+ * rejected. A non-zero task return value terminates the executor thread with
+ * that value.
+ *
+ * @param exec Pointer to the executor.
+ * @param task Pointer to the function to be executed periodically.
+ * @param arg User-defined argument passed to the task.
+ * @param attrs Task period and overrun policy.
+ * @return CL_OK on success, CL_ERR_INVAL if the period (or the stop limit of
+ * CL_OVERRUN_BH_STOP_AFTER_K) is zero or the policy realigns, CL_ERR_BUSY if
+ * the executor is already running, CL_ERR_NOMEM on allocation failure.
+ */
+cl_status_t cl_exec_add(struct cl_executor_s *exec, cl_task task, void *arg,
+                        const cl_attr_t *attrs);
+
+/**
+ * @brief Builds the schedule and spawns the executor thread.
+ *
+ * @param exec Pointer to the executor.
+ * @return CL_OK on success, CL_ERR_INVAL if no tasks were added, CL_ERR_BUSY
+ * if already running, CL_ERR_NOMEM on allocation failure, CL_ERR_START if
+ * thread creation fails.
+ */
+cl_status_t cl_exec_run(struct cl_executor_s *exec);
+
+/**
+ * @brief Signals the executor thread to stop gracefully.
+ *
+ * @param exec Pointer to the executor.
+ * @return CL_OK on success, CL_ERR_INVAL if the executor is not running.
+ */
+cl_status_t cl_exec_stop(struct cl_executor_s *exec);
+
+/**
+ * @brief Checks if the executor thread has finished execution.
+ *
+ * @param exec Pointer to the executor.
+ * @return true if the executor has finished, false otherwise.
+ */
+bool cl_exec_is_stopped(struct cl_executor_s *exec);
+
+/**
+ * @brief Waits for the executor thread to terminate.
+ *
+ * @param exec Pointer to the executor.
+ * @param ret [out] Non-zero task return value that terminated the executor.
+ * @return CL_OK on success, CL_ERR_JOIN on failure.
+ */
+cl_status_t cl_exec_join(struct cl_executor_s *exec, long *ret);
+
+/**
+ * @brief Returns the instance running the executor's frame loop.
+ *
+ * Valid after cl_exec_run(). May be used with the read-only instance API
+ * (e.g. cl_inst_get_stats()); its lifecycle is owned by the executor.
+ *
+ * @param exec Pointer to the executor.
+ * @return struct cl_instanse_s* The underlying instance, or NULL before run.
+ */
+struct cl_instanse_s *cl_exec_get_inst(struct cl_executor_s *exec);
+
+/**
+ * @brief Deallocates the executor and its underlying instance.
+ *
+ * @param exec Pointer to the executor.
+ * @return CL_OK on success, CL_ERR_BUSY if the executor has not been joined
+ * yet.
+ */
+cl_status_t cl_exec_destroy(struct cl_executor_s *exec);
+
+/**
+ * @brief Opaque handle to a group of instances with a synchronized release.
+ *
+ * All threads of a group are spawned first and parked (after their warm-up)
+ * until every one of them is ready. They are then released at one common
+ * CLOCK_MONOTONIC instant, each shifted by its own phase offset, so that the
+ * relative phasing of the tasks is deterministic. start_align is ignored for
+ * grouped instances.
+ */
+struct cl_group_s;
+
+/**
+ * @brief Creates a new, empty group.
+ *
+ * @return struct cl_group_s* Pointer to the group, or NULL on allocation
+ * failure.
+ */
+struct cl_group_s *cl_group_create(void);
+
+/**
+ * @brief Creates an instance owned by the group.
+ *
+ * The instance must not be run, joined or destroyed individually; the read-only
+ * instance API (e.g. cl_inst_get_stats()) may be used on it.
+ *
+ * @param grp Pointer to the group.
+ * @param task Pointer to the function to be executed periodically.
+ * @param arg User-defined argument passed to the task.
+ * @param attrs Configuration structure of the instance.
+ * @param phase_us Offset of the first cycle from the common release instant.
+ * @return struct cl_instanse_s* Pointer to the instance, or NULL on failure or
+ * if the group is already running.
+ */
+struct cl_instanse_s *cl_group_add(struct cl_group_s *grp, cl_task task,
+                                   void *arg, const cl_attr_t *attrs,
+                                   size_t phase_us);
+
+/**
+ * @brief Spawns all threads of the group and releases them together.
+ *
+ * Blocks until every thread is parked, then sets the common release instant
+ * @p start_delay_us after that moment.
+ *
+ * @param grp Pointer to the group.
+ * @param start_delay_us Lead time between the last thread being ready and the
+ * common release.
+ * @return CL_OK on success, CL_ERR_INVAL if the group is empty, CL_ERR_BUSY if
+ * already running, CL_ERR_START if a thread could not be created or one
+ * ended or was cancelled before the release, e.g. on a failing warm-up (the
+ * threads already spawned are stopped and joined).
+ */
+cl_status_t cl_group_run(struct cl_group_s *grp, size_t start_delay_us);
+
+/**
+ * @brief Signals all instances of the group to stop gracefully.
+ *
+ * @param grp Pointer to the group.
+ * @return CL_OK on success.
+ */
+cl_status_t cl_group_stop(struct cl_group_s *grp);
+
+/**
+ * @brief Checks if all instances of the group have finished execution.
+ *
+ * @param grp Pointer to the group.
+ * @return true if every instance has finished, false otherwise.
+ */
+bool cl_group_is_stopped(struct cl_group_s *grp);
+
+/**
+ * @brief Waits for all threads of the group to terminate.
+ *
+ * @param grp Pointer to the group.
+ * @param rets [out] Optional array of cl_group_size() return values.
+ * @return CL_OK on success, CL_ERR_JOIN if any join failed.
+ */
+cl_status_t cl_group_join(struct cl_group_s *grp, long *rets);
+
+/**
+ * @brief Returns the number of instances in the group.
+ *
+ * @param grp Pointer to the group.
+ * @return size_t Number of instances added with cl_group_add().
+ */
+size_t cl_group_size(struct cl_group_s *grp);
+
+/**
+ * @brief Deallocates the group and all of its instances.
+ *
+ * @param grp Pointer to the group.
+ * @return CL_OK on success, CL_ERR_BUSY if the group has not been joined yet.
+ */
+cl_status_t cl_group_destroy(struct cl_group_s *grp);
+
+/**
+ * @brief Opaque handle to the instances of a configuration file.
+ *
+ * The file is INI-like: "key = value" lines, '#' or ';' comments, one
+ * [name] section per task and an optional [corelock] section with
+ * group (release all tasks through a cl_group), start_delay_us, library
+ * (default for the tasks) and max_util_pct (default 100).
+ *
+ * Task keys: symbol (the cl_task, resolved with dlsym()), arg (optional data
+ * symbol passed as the task argument), library (shared object to dlopen()
+ * instead of the executable, which then needs -rdynamic), period_us, cpus
+ * (cpulist, e.g. "2-3,6"), policy (other, fifo, rr, deadline), priority,
+ * runtime_us, deadline_us, overrun (stop, notify, ignore, skip, catchup,
+ * stop_after), catchup_max, stop_limit, stop_window, start_align, wait_mode
+ * (sleep, spin, hybrid), spin_margin_us, warmup_cycles, stop_time, stats,
+ * numa_local, shm_name, phase_us (group only) and wcet_us. Omitted keys keep
+ * their cl_make_def_attrs() value; symbol, period_us and cpus are required.
+ *
+ * @code
+ * [corelock]
+ * group = true
+ *
+ * [control]
+ * symbol = control_step
+ * period_us = 1000
+ * cpus = 2
+ * wcet_us = 300
+ * @endcode
+ */
+struct cl_config_s;
+
+/**
+ * @brief Parses @p path, validates it and creates all of its instances.
+ *
+ * Before anything is created, the utilization of every CPU (runtime_us for
+ * SCHED_DEADLINE, wcet_us otherwise, over period_us) is summed over the tasks
+ * allowed on it and checked against max_util_pct. Tasks without an estimate
+ * count as zero. Errors are reported on stderr with their line.
+ *
+ * @param path Configuration file.
+ * @return struct cl_config_s* Pointer to the configuration, or NULL if the
+ * file is invalid, a symbol is missing, a CPU is overloaded or an instance
+ * could not be created.
+ */
+struct cl_config_s *cl_config_load(const char *path);
+
+/**
+ * @brief Starts all instances, as a group if the file asks for one.
+ *
+ * @param cfg Pointer to the configuration.
+ * @return CL_OK on success, CL_ERR_BUSY if already running, CL_ERR_START if
+ * an instance failed to start (the ones already started are stopped and
+ * joined).
+ */
+cl_status_t cl_config_run(struct cl_config_s *cfg);
+
+/**
+ * @brief Signals all instances to stop gracefully.
+ *
+ * @param cfg Pointer to the configuration.
+ * @return CL_OK on success.
+ */
+cl_status_t cl_config_stop(struct cl_config_s *cfg);
+
+/**
+ * @brief Waits for all threads of the configuration to terminate.
+ *
+ * @param cfg Pointer to the configuration.
+ * @param rets [out] Optional array of cl_config_size() return values.
+ * @return CL_OK on success, CL_ERR_JOIN if any join failed.
+ */
+cl_status_t cl_config_join(struct cl_config_s *cfg, long *rets);
+
+/**
+ * @brief Returns the number of tasks, in file order.
+ *
+ * @param cfg Pointer to the configuration.
+ * @return size_t Number of task sections.
+ */
+size_t cl_config_size(struct cl_config_s *cfg);
+
+/**
+ * @brief Returns the instance of the @p idx-th task.
+ *
+ * Like grouped instances, it must not be run, joined or destroyed
+ * individually.
+ *
+ * @param cfg Pointer to the configuration.
+ * @param idx Index of the task in file order.
+ * @return struct cl_instanse_s* Pointer to the instance, NULL if out of range.
+ */
+struct cl_instanse_s *cl_config_inst(struct cl_config_s *cfg, size_t idx);
+
+/**
+ * @brief Returns the instance of the task section @p name.
+ *
+ * @param cfg Pointer to the configuration.
+ * @param name Section name of the task.
+ * @return struct cl_instanse_s* Pointer to the instance, NULL if not found.
+ */
+struct cl_instanse_s *cl_config_find(struct cl_config_s *cfg,
+                                     const char *name);
+
+/**
+ * @brief Deallocates all instances and closes the loaded libraries.
+ *
+ * @param cfg Pointer to the configuration.
+ * @return CL_OK on success, CL_ERR_BUSY if it ran and has not been joined.
+ */
+cl_status_t cl_config_destroy(struct cl_config_s *cfg);
+
+/**
+ * @brief Opaque handle to a single-writer/single-reader triple buffer.
+ *
+ * Exchanges the latest value of a fixed-size message between a cl_task and a
+ * non-RT thread without locks, allocations or syscalls. The writer fills the
+ * back buffer in place and publishes it; the reader always gets the most
+ * recent complete message. Both sides are wait-free. Buffers are
+ * cache-line aligned. Use one triple buffer per direction.
+ */
+struct cl_tbuf_s;
+
+/**
+ * @brief Allocates a triple buffer for messages of @p size bytes.
+ *
+ * @param size Message size in bytes.
+ * @return struct cl_tbuf_s* Pointer to the triple buffer, or NULL on failure.
+ */
+struct cl_tbuf_s *cl_tbuf_create(size_t size);
+
+/**
+ * @brief Returns the writer's back buffer to fill in place (zero-copy).
+ *
+ * The content is the message written before the last one, not the last one.
+ *
+ * @param tb Pointer to the triple buffer.
+ * @return void* Back buffer of cl_tbuf_create() size bytes.
+ */
+void *cl_tbuf_write_buf(struct cl_tbuf_s *tb);
+
+/**
+ * @brief Publishes the back buffer as the latest message.
+ *
+ * @param tb Pointer to the triple buffer.
+ */
+void cl_tbuf_publish(struct cl_tbuf_s *tb);
+
+/**
+ * @brief Returns the latest published message.
+ *
+ * The returned buffer stays valid and unchanged until the next call.
+ *
+ * @param tb Pointer to the triple buffer.
+ * @param updated [out] Optional, set to true if a new message arrived since
+ * the previous call.
+ * @return const void* Front buffer (zero-filled before the first publish).
+ */
+const void *cl_tbuf_read(struct cl_tbuf_s *tb, bool *updated);
+
+/**
+ * @brief Deallocates the triple buffer.
+ *
+ * @param tb Pointer to the triple buffer.
+ */
+void cl_tbuf_destroy(struct cl_tbuf_s *tb);
+
+/**
+ * @brief Opaque handle to a single-writer seqlock channel.
+ *
+ * The writer never blocks; any number of readers copy out a consistent
+ * snapshot, retrying if they overlapped with a write.
+ */
+struct cl_seqch_s;
+
+/**
+ * @brief Allocates a seqlock channel for messages of @p size bytes.
+ *
+ * @param size Message size in bytes.
+ * @return struct cl_seqch_s* Pointer to the channel, or NULL on failure.
+ */
+struct cl_seqch_s *cl_seqch_create(size_t size);
+
+/**
+ * @brief Publishes a new message. Single writer only.
+ *
+ * @param ch Pointer to the channel.
+ * @param data Message of cl_seqch_create() size bytes.
+ */
+void cl_seqch_write(struct cl_seqch_s *ch, const void *data);
+
+/**
+ * @brief Copies out the latest message, retrying until it is consistent.
+ *
+ * @param ch Pointer to the channel.
+ * @param out [out] Destination of cl_seqch_create() size bytes.
+ * @return unsigned Sequence number of the snapshot (even, grows on each write).
+ */
+unsigned cl_seqch_read(struct cl_seqch_s *ch, void *out);
+
+/**
+ * @brief Single read attempt that never spins. Suitable for the RT side.
+ *
+ * @param ch Pointer to the channel.
+ * @param out [out] Destination, only valid if CL_OK is returned.
+ * @return CL_OK on success, CL_ERR_BUSY if a write was in progress.
+ */
+cl_status_t cl_seqch_try_read(struct cl_seqch_s *ch, void *out);
+
+/**
+ * @brief Deallocates the channel.
+ *
+ * @param ch Pointer to the channel.
+ */
+void cl_seqch_destroy(struct cl_seqch_s *ch);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,82 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+/* Alignment of every arena block, as guaranteed by malloc(). */
+#define CL_ARENA_ALIGN 16
+
+_Thread_local cl_instanse *cl_arena_owner;
+
+bool cl_arena_init(cl_instanse *inst) {
+  size_t size = inst->attrs.arena_size;
+
+  if (!size)
+    return !inst->attrs.arena_interpose;
+#ifndef CL_MALLOC_HOOK
+  if (inst->attrs.arena_interpose)
+    return false;
+#endif
+  /* Zero-filled, so the pages are already faulted in */
+  inst->arena_base = cl_mem_alloc(size, inst->numa_node);
+  if (!inst->arena_base)
+    return false;
+  if (mlock(inst->arena_base, size)) {
+    cl_mem_free(inst->arena_base, size, inst->numa_node);
+    inst->arena_base = NULL;
+    return false;
+  }
+#ifdef CL_MALLOC_HOOK
+  if (inst->attrs.arena_interpose && !cl_arena_hook_add(inst)) {
+    cl_arena_free(inst);
+    return false;
+  }
+#endif
+  return true;
+}
+
+void cl_arena_free(cl_instanse *inst) {
+  if (!inst->arena_base)
+    return;
+#ifdef CL_MALLOC_HOOK
+  if (inst->attrs.arena_interpose)
+    cl_arena_hook_remove(inst);
+#endif
+  munlock(inst->arena_base, inst->attrs.arena_size);
+  cl_mem_free(inst->arena_base, inst->attrs.arena_size, inst->numa_node);
+  inst->arena_base = NULL;
+}
+
+void *cl_arena_take(cl_instanse *inst, size_t size, size_t align) {
+  size_t off = (inst->arena_used + align - 1) & ~(align - 1);
+
+  if (off > inst->attrs.arena_size || size > inst->attrs.arena_size - off) {
+    atomic_fetch_add_explicit(&inst->arena_fallbacks, 1, memory_order_relaxed);
+    return NULL;
+  }
+  inst->arena_used = off + size;
+  if (inst->arena_used >
+      atomic_load_explicit(&inst->arena_peak, memory_order_relaxed))
+    atomic_store_explicit(&inst->arena_peak, inst->arena_used,
+                          memory_order_relaxed);
+  return inst->arena_base + off;
+}
+
+void *cl_arena_alloc(struct cl_instanse_s *inst, size_t size) {
+  return cl_arena_take(inst, size, CL_ARENA_ALIGN);
+}
+
+void cl_arena_reset(struct cl_instanse_s *inst) { inst->arena_used = 0; }
+
+cl_status_t cl_inst_get_arena_info(struct cl_instanse_s *inst,
+                                   cl_arena_info_t *info) {
+  if (!inst->arena_base)
+    return CL_ERR_INVAL;
+  info->size = inst->attrs.arena_size;
+  info->peak = atomic_load_explicit(&inst->arena_peak, memory_order_relaxed);
+  info->fallbacks =
+      atomic_load_explicit(&inst->arena_fallbacks, memory_order_relaxed);
+  return CL_OK;
+}
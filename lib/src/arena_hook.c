@@ -0,0 +1,155 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * malloc family interposer of the CORELOCK_MALLOC_HOOK build. While a task
+ * of an instance with arena_interpose runs, its allocations come from the
+ * instance arena; everything else goes to glibc. Arena blocks carry their
+ * size in front of them for realloc(), and free() of an arena block is a
+ * no-op from any thread.
+ */
+
+#define CL_ARENA_HDR 16
+#define CL_ARENA_MAX_HOOKED 64
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+/* Address ranges of the interposed arenas, scanned by free(). */
+static struct {
+  atomic_uintptr_t base;
+  atomic_uintptr_t end;
+} hooked[CL_ARENA_MAX_HOOKED];
+static atomic_int hooked_top;
+
+bool cl_arena_hook_add(cl_instanse *inst) {
+  uintptr_t base = (uintptr_t)inst->arena_base;
+
+  for (int i = 0; i < CL_ARENA_MAX_HOOKED; i++) {
+    uintptr_t expected = 0;
+    if (!atomic_compare_exchange_strong(&hooked[i].base, &expected, base))
+      continue;
+    atomic_store(&hooked[i].end, base + inst->attrs.arena_size);
+    int top = atomic_load(&hooked_top);
+    while (top <= i && !atomic_compare_exchange_weak(&hooked_top, &top, i + 1))
+      ;
+    return true;
+  }
+  return false;
+}
+
+void cl_arena_hook_remove(cl_instanse *inst) {
+  for (int i = 0; i < CL_ARENA_MAX_HOOKED; i++)
+    if (atomic_load(&hooked[i].base) == (uintptr_t)inst->arena_base) {
+      atomic_store(&hooked[i].end, 0);
+      atomic_store(&hooked[i].base, 0);
+    }
+}
+
+static bool in_arena(const void *ptr) {
+  uintptr_t addr = (uintptr_t)ptr;
+  int top = atomic_load_explicit(&hooked_top, memory_order_acquire);
+
+  for (int i = 0; i < top; i++)
+    if (addr >= atomic_load_explicit(&hooked[i].base, memory_order_relaxed) &&
+        addr < atomic_load_explicit(&hooked[i].end, memory_order_relaxed))
+      return true;
+  return false;
+}
+
+static void *arena_block(cl_instanse *inst, size_t size, size_t align) {
+  unsigned char *mem;
+
+  if (align < CL_ARENA_HDR)
+    align = CL_ARENA_HDR;
+  align = cl_round_up_pow2(align);
+  if (size > SIZE_MAX - 2 * align)
+    return NULL;
+  mem = cl_arena_take(inst, size + align, align);
+  if (!mem)
+    return NULL;
+  mem += align;
+  memcpy(mem - sizeof(size), &size, sizeof(size));
+  return mem;
+}
+
+void *malloc(size_t size) {
+  cl_instanse *inst = cl_arena_owner;
+  void *mem;
+
+  if (inst && (mem = arena_block(inst, size, CL_ARENA_HDR)))
+    return mem;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  cl_instanse *inst = cl_arena_owner;
+  void *mem;
+
+  if (size && n > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  /* The arena is reused across cycles, so blocks are not zero */
+  if (inst && (mem = arena_block(inst, n * size, CL_ARENA_HDR))) {
+    memset(mem, 0, n * size);
+    return mem;
+  }
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  size_t old;
+  void *mem;
+
+  if (!ptr)
+    return malloc(size);
+  if (!in_arena(ptr))
+    return __libc_realloc(ptr, size);
+  memcpy(&old, (unsigned char *)ptr - sizeof(old), sizeof(old));
+  if (size <= old)
+    return ptr;
+  mem = malloc(size);
+  if (mem)
+    memcpy(mem, ptr, old);
+  return mem;
+}
+
+void free(void *ptr) {
+  if (ptr && !in_arena(ptr))
+    __libc_free(ptr);
+}
+
+void *memalign(size_t align, size_t size) {
+  cl_instanse *inst = cl_arena_owner;
+  void *mem;
+
+  if (inst && (mem = arena_block(inst, size, align)))
+    return mem;
+  return __libc_memalign(align, size);
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+  return memalign(align, size);
+}
+
+int posix_memalign(void **out, size_t align, size_t size) {
+  void *mem;
+
+  if (!align || (align & (align - 1)) || align % sizeof(void *))
+    return EINVAL;
+  mem = memalign(align, size);
+  if (!mem)
+    return ENOMEM;
+  *out = mem;
+  return 0;
+}
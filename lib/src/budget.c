@@ -0,0 +1,91 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Older glibc names the SIGEV_THREAD_ID target only through the union. */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+_Thread_local cl_instanse *cl_self;
+
+/* Only timer signals carry an instance pointer, other senders are ignored. */
+static void budget_handler(int signo, siginfo_t *info, void *uctx) {
+  cl_instanse *inst;
+  CL_UNUSED(signo);
+  CL_UNUSED(uctx);
+
+  if (info->si_code != SI_TIMER)
+    return;
+  inst = info->si_value.sival_ptr;
+  atomic_store_explicit(&inst->budget_expired, 1, memory_order_relaxed);
+  if (inst->attrs.budget_fn)
+    inst->attrs.budget_fn(inst, inst->arg);
+}
+
+bool cl_budget_init(cl_instanse *inst) {
+  struct sigaction sa = {.sa_sigaction = budget_handler,
+                         .sa_flags = SA_SIGINFO | SA_RESTART};
+
+  if (!inst->attrs.budget_pct)
+    return true;
+  if (inst->attrs.budget_pct >= 100)
+    return false;
+  if (!inst->attrs.budget_signal)
+    inst->attrs.budget_signal = SIGRTMIN;
+  sigemptyset(&sa.sa_mask);
+  return !sigaction(inst->attrs.budget_signal, &sa, NULL);
+}
+
+void cl_budget_update(cl_instanse *inst) {
+  inst->budget_slack_ticks =
+      inst->period_ticks * (100 - inst->attrs.budget_pct) / 100;
+}
+
+bool cl_budget_start(cl_instanse *inst) {
+  struct sigevent sev = {
+      .sigev_notify = SIGEV_THREAD_ID,
+      .sigev_signo = inst->attrs.budget_signal,
+      .sigev_value.sival_ptr = inst,
+      .sigev_notify_thread_id = gettid(),
+  };
+
+  cl_budget_update(inst);
+  return !timer_create(CLOCK_MONOTONIC, &sev, &inst->budget_timer);
+}
+
+void cl_budget_stop(cl_instanse *inst) {
+  timer_delete(inst->budget_timer);
+}
+
+void cl_budget_arm(cl_instanse *inst, uint64_t expiry) {
+  uint64_t ns = cl_clock_deadline_ns(&inst->clock, expiry);
+  struct itimerspec its = {
+      .it_value = {.tv_sec = (time_t)(ns / 1000000000ULL),
+                   .tv_nsec = (long)(ns % 1000000000ULL)},
+  };
+
+  atomic_store_explicit(&inst->budget_expired, 0, memory_order_relaxed);
+  timer_settime(inst->budget_timer, TIMER_ABSTIME, &its, NULL);
+}
+
+void cl_budget_disarm(cl_instanse *inst) {
+  static const struct itimerspec its;
+  timer_settime(inst->budget_timer, 0, &its, NULL);
+}
+
+struct cl_instanse_s *cl_inst_self(void) { return cl_self; }
+
+long long cl_remaining_ns(struct cl_instanse_s *inst) {
+  const cl_clock *clk = &inst->clock;
+  return cl_diff_ns(clk, inst->deadline_tick, cl_clock_now(clk));
+}
+
+bool cl_budget_expired(struct cl_instanse_s *inst) {
+  return atomic_load_explicit(&inst->budget_expired, memory_order_relaxed);
+}
@@ -0,0 +1,138 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Set in the shared index when the middle slot holds an unread message. */
+#define CL_TBUF_DIRTY 4u
+#define CL_TBUF_INDEX 3u
+
+typedef struct cl_tbuf_s {
+  unsigned char *slots;
+  size_t slot_size;
+  alignas(CL_CACHE_LINE) unsigned back;
+  alignas(CL_CACHE_LINE) atomic_uint middle;
+  alignas(CL_CACHE_LINE) unsigned front;
+} cl_tbuf;
+
+typedef struct cl_seqch_s {
+  unsigned char *data;
+  size_t size;
+  alignas(CL_CACHE_LINE) atomic_uint seq;
+} cl_seqch;
+
+static size_t round_up_line(size_t size) {
+  return (size + CL_CACHE_LINE - 1) & ~(size_t)(CL_CACHE_LINE - 1);
+}
+
+static void *alloc_lines(size_t size) {
+  void *mem = aligned_alloc(CL_CACHE_LINE, round_up_line(size));
+  if (mem)
+    memset(mem, 0, round_up_line(size));
+  return mem;
+}
+
+struct cl_tbuf_s *cl_tbuf_create(size_t size) {
+  cl_tbuf *tb;
+
+  if (!size)
+    return NULL;
+  tb = alloc_lines(sizeof(*tb));
+  if (!tb)
+    return NULL;
+  tb->slot_size = round_up_line(size);
+  tb->slots = alloc_lines(3 * tb->slot_size);
+  if (!tb->slots) {
+    free(tb);
+    return NULL;
+  }
+  tb->front = 0;
+  atomic_init(&tb->middle, 1);
+  tb->back = 2;
+  return tb;
+}
+
+void *cl_tbuf_write_buf(struct cl_tbuf_s *tb) {
+  return tb->slots + tb->back * tb->slot_size;
+}
+
+void cl_tbuf_publish(struct cl_tbuf_s *tb) {
+  unsigned old = atomic_exchange_explicit(
+      &tb->middle, tb->back | CL_TBUF_DIRTY, memory_order_acq_rel);
+  tb->back = old & CL_TBUF_INDEX;
+}
+
+const void *cl_tbuf_read(struct cl_tbuf_s *tb, bool *updated) {
+  bool fresh =
+      atomic_load_explicit(&tb->middle, memory_order_relaxed) & CL_TBUF_DIRTY;
+
+  if (fresh) {
+    unsigned old = atomic_exchange_explicit(&tb->middle, tb->front,
+                                            memory_order_acq_rel);
+    tb->front = old & CL_TBUF_INDEX;
+  }
+  if (updated)
+    *updated = fresh;
+  return tb->slots + tb->front * tb->slot_size;
+}
+
+void cl_tbuf_destroy(struct cl_tbuf_s *tb) {
+  free(tb->slots);
+  free(tb);
+}
+
+struct cl_seqch_s *cl_seqch_create(size_t size) {
+  cl_seqch *ch;
+
+  if (!size)
+    return NULL;
+  ch = alloc_lines(sizeof(*ch));
+  if (!ch)
+    return NULL;
+  ch->size = size;
+  ch->data = alloc_lines(size);
+  if (!ch->data) {
+    free(ch);
+    return NULL;
+  }
+  return ch;
+}
+
+void cl_seqch_write(struct cl_seqch_s *ch, const void *data) {
+  unsigned seq = atomic_load_explicit(&ch->seq, memory_order_relaxed);
+
+  atomic_store_explicit(&ch->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(ch->data, data, ch->size);
+  atomic_store_explicit(&ch->seq, seq + 2, memory_order_release);
+}
+
+static bool seqch_read_once(struct cl_seqch_s *ch, void *out, unsigned *seq) {
+  *seq = atomic_load_explicit(&ch->seq, memory_order_acquire);
+  if (*seq & 1)
+    return false;
+  memcpy(out, ch->data, ch->size);
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(&ch->seq, memory_order_relaxed) == *seq;
+}
+
+unsigned cl_seqch_read(struct cl_seqch_s *ch, void *out) {
+  unsigned seq;
+  while (!seqch_read_once(ch, out, &seq))
+    cl_cpu_relax();
+  return seq;
+}
+
+cl_status_t cl_seqch_try_read(struct cl_seqch_s *ch, void *out) {
+  unsigned seq;
+  return seqch_read_once(ch, out, &seq) ? CL_OK : CL_ERR_BUSY;
+}
+
+void cl_seqch_destroy(struct cl_seqch_s *ch) {
+  free(ch->data);
+  free(ch);
+}
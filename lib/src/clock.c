@@ -0,0 +1,114 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#define CL_CALIB_SAMPLES 8
+#define CL_CALIB_INTERVAL_NS 20000000L
+#define CL_CLOCK_RESYNC_NS 100000000ULL
+
+static void clock_init_identity(cl_clock *clk) {
+  clk->source = CL_CLOCK_MONOTONIC;
+  clk->base_ticks = 0;
+  clk->base_ns = 0;
+  clk->ns_mult = 1ULL << 32;
+  clk->tick_mult = 1ULL << 32;
+}
+
+#if defined(__x86_64__)
+static bool tsc_is_invariant(void) {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    return false;
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return edx & (1U << 8);
+}
+
+/*
+ * Reads a (counter, CLOCK_MONOTONIC) pair. The monotonic read is bracketed by
+ * two counter reads and the tightest bracket out of several tries wins.
+ */
+static void sample_pair(uint64_t *ticks, uint64_t *ns) {
+  uint64_t best = UINT64_MAX;
+
+  *ticks = 0;
+  *ns = 0;
+  for (int i = 0; i < CL_CALIB_SAMPLES; i++) {
+    uint64_t t0 = cl_counter_read();
+    uint64_t mono = cl_mono_ns();
+    uint64_t t1 = cl_counter_read();
+    if (t1 - t0 < best) {
+      best = t1 - t0;
+      *ticks = t0 + (t1 - t0) / 2;
+      *ns = mono;
+    }
+  }
+}
+
+static bool clock_init_counter(cl_clock *clk) {
+  uint64_t t0, t1, n0, n1;
+  struct timespec interval = {.tv_sec = 0, .tv_nsec = CL_CALIB_INTERVAL_NS};
+
+  if (!tsc_is_invariant())
+    return false;
+
+  sample_pair(&t0, &n0);
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
+  sample_pair(&t1, &n1);
+  if (t1 <= t0 || n1 <= n0)
+    return false;
+
+  clk->base_ticks = t1;
+  clk->base_ns = n1;
+  clk->ns_mult = ((n1 - n0) << 32) / (t1 - t0);
+  clk->tick_mult = ((t1 - t0) << 32) / (n1 - n0);
+  cl_clock_resync(clk);
+  return true;
+}
+#elif defined(__aarch64__)
+static bool clock_init_counter(cl_clock *clk) {
+  uint64_t freq;
+  __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+  if (!freq)
+    return false;
+
+  clk->base_ticks = cl_counter_read();
+  clk->base_ns = cl_mono_ns();
+  clk->ns_mult = (uint64_t)(((cl_u128)1000000000ULL << 32) / freq);
+  clk->tick_mult = (uint64_t)(((cl_u128)freq << 32) / 1000000000ULL);
+  cl_clock_resync(clk);
+  return true;
+}
+#else
+static bool clock_init_counter(cl_clock *clk) {
+  CL_UNUSED(clk);
+  return false;
+}
+#endif
+
+void cl_clock_resync(cl_clock *clk) {
+#if defined(__x86_64__)
+  sample_pair(&clk->sync_ticks, &clk->sync_ns);
+#else
+  clk->sync_ticks = cl_counter_read();
+  clk->sync_ns = cl_mono_ns();
+#endif
+  clk->resync_tick =
+      clk->sync_ticks + cl_ns_to_ticks(clk, CL_CLOCK_RESYNC_NS);
+}
+
+bool cl_clock_init(cl_clock *clk, cl_clock_source source) {
+  clock_init_identity(clk);
+  if (source == CL_CLOCK_MONOTONIC)
+    return true;
+  if (source != CL_CLOCK_CPU_COUNTER || !clock_init_counter(clk))
+    return false;
+  clk->source = CL_CLOCK_CPU_COUNTER;
+  return true;
+}
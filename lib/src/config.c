@@ -0,0 +1,568 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <ctype.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CL_CFG_GLOBAL "corelock"
+#define CL_CFG_DEF_MAX_UTIL 100
+
+typedef struct {
+  const char *name;
+  int value;
+} cl_cfg_enum;
+
+typedef struct {
+  char *name;
+  char *symbol;
+  char *arg;
+  char *library;
+  char *shm_name;
+  unsigned line;
+  bool has_priority;
+  cpu_set_t cpus;
+  size_t phase_us;
+  size_t wcet_us;
+  cl_attr_t attrs;
+} cl_cfg_task;
+
+typedef struct cl_config_s {
+  cl_cfg_task *tasks;
+  size_t n_tasks;
+  struct cl_instanse_s **insts;
+  struct cl_group_s *group;
+  /* dlopen() handles, one per distinct library path. */
+  char **lib_paths;
+  void **libs;
+  size_t n_libs;
+  char *library;
+  bool use_group;
+  size_t start_delay_us;
+  unsigned max_util_pct;
+  bool running;
+} cl_config;
+
+static const cl_cfg_enum policy_names[] = {
+    {"other", SCHED_OTHER},
+    {"fifo", SCHED_FIFO},
+    {"rr", SCHED_RR},
+    {"deadline", SCHED_DEADLINE},
+};
+
+static const cl_cfg_enum overrun_names[] = {
+    {"stop", CL_OVERRUN_BH_STOP},
+    {"notify", CL_OVERRUN_BH_NOTIFY},
+    {"ignore", CL_OVERRUN_BH_IGNORE},
+    {"skip", CL_OVERRUN_BH_SKIP},
+    {"catchup", CL_OVERRUN_BH_CATCHUP_N},
+    {"stop_after", CL_OVERRUN_BH_STOP_AFTER_K},
+};
+
+static const cl_cfg_enum wait_names[] = {
+    {"sleep", CL_WAIT_SLEEP},
+    {"spin", CL_WAIT_SPIN},
+    {"hybrid", CL_WAIT_HYBRID},
+};
+
+#define CL_CFG_ENUM(names, val, out)                                           \
+  parse_enum(names, sizeof(names) / sizeof(*names), val, out)
+
+static char *trim(char *str) {
+  char *end;
+
+  while (isspace((unsigned char)*str))
+    str++;
+  end = str + strlen(str);
+  while (end > str && isspace((unsigned char)end[-1]))
+    *--end = '\0';
+  return str;
+}
+
+/* Cuts a '#' or ';' comment that starts the line or follows a blank. */
+static void strip_comment(char *str) {
+  for (char *pos = str; *pos; pos++)
+    if ((*pos == '#' || *pos == ';') &&
+        (pos == str || isspace((unsigned char)pos[-1]))) {
+      *pos = '\0';
+      return;
+    }
+}
+
+static bool parse_size(const char *val, size_t *out) {
+  unsigned long long num;
+  char *end;
+
+  if (!isdigit((unsigned char)*val))
+    return false;
+  num = strtoull(val, &end, 10);
+  if (*end || num > SIZE_MAX)
+    return false;
+  *out = (size_t)num;
+  return true;
+}
+
+static bool parse_uint(const char *val, unsigned *out) {
+  size_t num;
+
+  if (!parse_size(val, &num) || num > UINT_MAX)
+    return false;
+  *out = (unsigned)num;
+  return true;
+}
+
+static bool parse_int(const char *val, int *out) {
+  long num;
+  char *end;
+
+  num = strtol(val, &end, 10);
+  if (end == val || *end || num < INT_MIN || num > INT_MAX)
+    return false;
+  *out = (int)num;
+  return true;
+}
+
+static bool parse_double(const char *val, double *out) {
+  char *end;
+
+  *out = strtod(val, &end);
+  return end != val && !*end && *out >= 0;
+}
+
+static bool parse_bool(const char *val, bool *out) {
+  if (!strcmp(val, "true") || !strcmp(val, "yes") || !strcmp(val, "on") ||
+      !strcmp(val, "1"))
+    *out = true;
+  else if (!strcmp(val, "false") || !strcmp(val, "no") ||
+           !strcmp(val, "off") || !strcmp(val, "0"))
+    *out = false;
+  else
+    return false;
+  return true;
+}
+
+static bool parse_enum(const cl_cfg_enum *names, size_t n_names,
+                       const char *val, int *out) {
+  for (size_t i = 0; i < n_names; i++)
+    if (!strcmp(val, names[i].name)) {
+      *out = names[i].value;
+      return true;
+    }
+  return false;
+}
+
+static bool parse_str(const char *val, char **out) {
+  char *copy = strdup(val);
+
+  if (!copy)
+    return false;
+  free(*out);
+  *out = copy;
+  return true;
+}
+
+/* Applies one key of a task section. Returns an error message or NULL. */
+static const char *task_key(cl_cfg_task *task, const char *key,
+                            const char *val) {
+  cl_attr_t *attrs = &task->attrs;
+  int num;
+
+  if (!strcmp(key, "symbol"))
+    return parse_str(val, &task->symbol) ? NULL : "out of memory";
+  if (!strcmp(key, "arg"))
+    return parse_str(val, &task->arg) ? NULL : "out of memory";
+  if (!strcmp(key, "library"))
+    return parse_str(val, &task->library) ? NULL : "out of memory";
+  if (!strcmp(key, "shm_name"))
+    return parse_str(val, &task->shm_name) ? NULL : "out of memory";
+  if (!strcmp(key, "cpus"))
+    return cl_parse_cpulist(val, &task->cpus) ? NULL : "invalid cpu list";
+  if (!strcmp(key, "period_us"))
+    return parse_size(val, &attrs->period_us) ? NULL : "invalid period_us";
+  if (!strcmp(key, "priority")) {
+    task->has_priority = true;
+    return parse_int(val, &attrs->priority) ? NULL : "invalid priority";
+  }
+  if (!strcmp(key, "policy"))
+    return CL_CFG_ENUM(policy_names, val, &attrs->sched_policy)
+               ? NULL
+               : "policy must be other, fifo, rr or deadline";
+  if (!strcmp(key, "runtime_us"))
+    return parse_size(val, &attrs->runtime_us) ? NULL : "invalid runtime_us";
+  if (!strcmp(key, "deadline_us"))
+    return parse_size(val, &attrs->deadline_us) ? NULL
+                                                : "invalid deadline_us";
+  if (!strcmp(key, "overrun")) {
+    if (!CL_CFG_ENUM(overrun_names, val, &num))
+      return "overrun must be stop, notify, ignore, skip, catchup or "
+             "stop_after";
+    attrs->or_bh = (cl_overrun_bh)num;
+    return NULL;
+  }
+  if (!strcmp(key, "catchup_max"))
+    return parse_uint(val, &attrs->or_catchup_max) ? NULL
+                                                   : "invalid catchup_max";
+  if (!strcmp(key, "stop_limit"))
+    return parse_uint(val, &attrs->or_stop_limit) ? NULL
+                                                  : "invalid stop_limit";
+  if (!strcmp(key, "stop_window"))
+    return parse_uint(val, &attrs->or_stop_window) ? NULL
+                                                   : "invalid stop_window";
+  if (!strcmp(key, "start_align"))
+    return parse_int(val, &attrs->start_align) ? NULL : "invalid start_align";
+  if (!strcmp(key, "wait_mode")) {
+    if (!CL_CFG_ENUM(wait_names, val, &num))
+      return "wait_mode must be sleep, spin or hybrid";
+    attrs->wait_mode = (cl_wait_mode)num;
+    return NULL;
+  }
+  if (!strcmp(key, "spin_margin_us"))
+    return parse_size(val, &attrs->spin_margin_us) ? NULL
+                                                   : "invalid spin_margin_us";
+  if (!strcmp(key, "warmup_cycles"))
+    return parse_uint(val, &attrs->warmup_cycles) ? NULL
+                                                  : "invalid warmup_cycles";
+  if (!strcmp(key, "stop_time"))
+    return parse_double(val, &attrs->stop_time) ? NULL : "invalid stop_time";
+  if (!strcmp(key, "stats"))
+    return parse_bool(val, &attrs->collect_stats) ? NULL : "invalid stats";
+  if (!strcmp(key, "numa_local"))
+    return parse_bool(val, &attrs->numa_local) ? NULL : "invalid numa_local";
+  if (!strcmp(key, "phase_us"))
+    return parse_size(val, &task->phase_us) ? NULL : "invalid phase_us";
+  if (!strcmp(key, "wcet_us"))
+    return parse_size(val, &task->wcet_us) ? NULL : "invalid wcet_us";
+  return "unknown key";
+}
+
+static const char *global_key(cl_config *cfg, const char *key,
+                              const char *val) {
+  if (!strcmp(key, "group"))
+    return parse_bool(val, &cfg->use_group) ? NULL : "invalid group";
+  if (!strcmp(key, "start_delay_us"))
+    return parse_size(val, &cfg->start_delay_us) ? NULL
+                                                 : "invalid start_delay_us";
+  if (!strcmp(key, "max_util_pct"))
+    return parse_uint(val, &cfg->max_util_pct) ? NULL
+                                               : "invalid max_util_pct";
+  if (!strcmp(key, "library"))
+    return parse_str(val, &cfg->library) ? NULL : "out of memory";
+  return "unknown key";
+}
+
+static const char *add_task(cl_config *cfg, const char *name, unsigned line) {
+  cl_cfg_task *tasks, *task;
+
+  if (!*name)
+    return "empty section name";
+  for (size_t i = 0; i < cfg->n_tasks; i++)
+    if (!strcmp(cfg->tasks[i].name, name))
+      return "duplicate task";
+  tasks = realloc(cfg->tasks, (cfg->n_tasks + 1) * sizeof(*tasks));
+  if (!tasks)
+    return "out of memory";
+  cfg->tasks = tasks;
+  task = &tasks[cfg->n_tasks];
+  *task = (cl_cfg_task){.line = line,
+                        .attrs = cl_make_def_attrs(0, NULL, 0)};
+  CPU_ZERO(&task->cpus);
+  task->name = strdup(name);
+  if (!task->name)
+    return "out of memory";
+  cfg->n_tasks++;
+  return NULL;
+}
+
+static bool parse_file(cl_config *cfg, const char *path) {
+  cl_cfg_task *task = NULL;
+  bool global = false, ok = true;
+  const char *err = NULL;
+  unsigned line = 0;
+  size_t cap = 0;
+  char *buf = NULL;
+  FILE *in;
+
+  in = fopen(path, "r");
+  if (!in) {
+    perror(path);
+    return false;
+  }
+  while (ok && getline(&buf, &cap, in) >= 0) {
+    char *str, *sep;
+
+    line++;
+    strip_comment(buf);
+    str = trim(buf);
+    if (!*str)
+      continue;
+    if (*str == '[') {
+      sep = strchr(str, ']');
+      if (!sep || sep[1]) {
+        err = "malformed section header";
+      } else {
+        *sep = '\0';
+        str = trim(str + 1);
+        global = !strcmp(str, CL_CFG_GLOBAL);
+        if (!global && !(err = add_task(cfg, str, line)))
+          task = &cfg->tasks[cfg->n_tasks - 1];
+      }
+    } else if (!(sep = strchr(str, '='))) {
+      err = "expected key = value";
+    } else {
+      *sep = '\0';
+      if (global)
+        err = global_key(cfg, trim(str), trim(sep + 1));
+      else if (task)
+        err = task_key(task, trim(str), trim(sep + 1));
+      else
+        err = "key outside of a section";
+    }
+    if (err) {
+      fprintf(stderr, "%s:%u: %s\n", path, line, err);
+      ok = false;
+    }
+  }
+  free(buf);
+  fclose(in);
+  return ok;
+}
+
+/* Checks what a single key cannot, with the full file known. */
+static bool check_tasks(cl_config *cfg, const char *path) {
+  bool ok = true;
+
+  for (size_t i = 0; i < cfg->n_tasks; i++) {
+    cl_cfg_task *task = &cfg->tasks[i];
+    const char *err = NULL;
+
+    if (!task->symbol)
+      err = "missing symbol";
+    else if (!task->attrs.period_us)
+      err = "missing period_us";
+    else if (!CPU_COUNT(&task->cpus))
+      err = "missing cpus";
+    else if (task->phase_us && !cfg->use_group)
+      err = "phase_us needs group = true";
+    if (err) {
+      fprintf(stderr, "%s:%u: task %s: %s\n", path, task->line, task->name,
+              err);
+      ok = false;
+    }
+    /* The default priority is a SCHED_FIFO one */
+    if (!task->has_priority && (task->attrs.sched_policy == SCHED_OTHER ||
+                                task->attrs.sched_policy == SCHED_DEADLINE))
+      task->attrs.priority = 0;
+  }
+  if (ok && !cfg->n_tasks) {
+    fprintf(stderr, "%s: no tasks\n", path);
+    ok = false;
+  }
+  return ok;
+}
+
+/*
+ * Sums runtime_us (SCHED_DEADLINE) or wcet_us over period_us per CPU. A task
+ * allowed on several CPUs may run on any of them, so it is charged in full to
+ * each; tasks without an estimate are not counted.
+ */
+static bool check_utilization(cl_config *cfg, const char *path) {
+  double util[CPU_SETSIZE] = {0};
+  bool ok = true;
+
+  for (size_t i = 0; i < cfg->n_tasks; i++) {
+    const cl_cfg_task *task = &cfg->tasks[i];
+    size_t busy_us = task->attrs.sched_policy == SCHED_DEADLINE
+                         ? task->attrs.runtime_us
+                         : task->wcet_us;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &task->cpus))
+        util[cpu] += 100.0 * (double)busy_us / (double)task->attrs.period_us;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    if (util[cpu] > cfg->max_util_pct) {
+      fprintf(stderr, "%s: cpu %d is loaded to %.1f%%, above %u%%\n", path,
+              cpu, util[cpu], cfg->max_util_pct);
+      ok = false;
+    }
+  return ok;
+}
+
+static void *open_library(cl_config *cfg, const char *path) {
+  char **paths;
+  void **libs;
+  void *lib;
+
+  for (size_t i = 0; i < cfg->n_libs; i++)
+    if (!strcmp(cfg->lib_paths[i], path))
+      return cfg->libs[i];
+  paths = realloc(cfg->lib_paths, (cfg->n_libs + 1) * sizeof(*paths));
+  if (paths)
+    cfg->lib_paths = paths;
+  libs = realloc(cfg->libs, (cfg->n_libs + 1) * sizeof(*libs));
+  if (libs)
+    cfg->libs = libs;
+  if (!paths || !libs || !(paths[cfg->n_libs] = strdup(path)))
+    return NULL;
+  lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!lib) {
+    free(paths[cfg->n_libs]);
+    return NULL;
+  }
+  libs[cfg->n_libs++] = lib;
+  return lib;
+}
+
+/* Resolves the task and creates its instance, not started yet. */
+static bool create_task(cl_config *cfg, cl_cfg_task *task, const char *path,
+                        size_t idx) {
+  const char *library = task->library ? task->library : cfg->library;
+  void *lib = RTLD_DEFAULT, *sym, *arg = NULL;
+  cl_task fn;
+
+  if (library && !(lib = open_library(cfg, library))) {
+    const char *err = dlerror();
+    fprintf(stderr, "%s:%u: task %s: %s\n", path, task->line, task->name,
+            err ? err : "out of memory");
+    return false;
+  }
+  sym = dlsym(lib, task->symbol);
+  if (!sym || (task->arg && !(arg = dlsym(lib, task->arg)))) {
+    fprintf(stderr, "%s:%u: task %s: %s not found\n", path, task->line,
+            task->name, sym ? task->arg : task->symbol);
+    return false;
+  }
+  /* POSIX guarantees dlsym() results convert to function pointers */
+  memcpy(&fn, &sym, sizeof(fn));
+
+  task->attrs.cpu_mask = &task->cpus;
+  task->attrs.cpu_mask_size = sizeof(task->cpus);
+  task->attrs.shm_name = task->shm_name;
+  cfg->insts[idx] =
+      cfg->group ? cl_group_add(cfg->group, fn, arg, &task->attrs,
+                                task->phase_us)
+                 : cl_inst_create(fn, arg, &task->attrs);
+  if (!cfg->insts[idx]) {
+    fprintf(stderr, "%s:%u: task %s: invalid attributes\n", path, task->line,
+            task->name);
+    return false;
+  }
+  return true;
+}
+
+struct cl_config_s *cl_config_load(const char *path) {
+  cl_config *cfg = calloc(1, sizeof(*cfg));
+
+  if (!cfg)
+    return NULL;
+  cfg->max_util_pct = CL_CFG_DEF_MAX_UTIL;
+  if (!parse_file(cfg, path) || !check_tasks(cfg, path) ||
+      !check_utilization(cfg, path))
+    goto fail;
+
+  cfg->insts = calloc(cfg->n_tasks, sizeof(*cfg->insts));
+  if (!cfg->insts)
+    goto fail;
+  if (cfg->use_group && !(cfg->group = cl_group_create()))
+    goto fail;
+  for (size_t i = 0; i < cfg->n_tasks; i++)
+    if (!create_task(cfg, &cfg->tasks[i], path, i))
+      goto fail;
+  return cfg;
+
+fail:
+  cl_config_destroy(cfg);
+  return NULL;
+}
+
+cl_status_t cl_config_run(struct cl_config_s *cfg) {
+  if (cfg->running)
+    return CL_ERR_BUSY;
+  if (cfg->group) {
+    if (cl_group_run(cfg->group, cfg->start_delay_us) != CL_OK)
+      return CL_ERR_START;
+    cfg->running = true;
+    return CL_OK;
+  }
+  for (size_t i = 0; i < cfg->n_tasks; i++) {
+    if (cl_inst_run(cfg->insts[i]) == CL_OK)
+      continue;
+    for (size_t j = 0; j < i; j++)
+      cl_inst_stop(cfg->insts[j]);
+    for (size_t j = 0; j < i; j++)
+      cl_inst_join(cfg->insts[j], NULL);
+    return CL_ERR_START;
+  }
+  cfg->running = true;
+  return CL_OK;
+}
+
+cl_status_t cl_config_stop(struct cl_config_s *cfg) {
+  if (cfg->group)
+    return cl_group_stop(cfg->group);
+  for (size_t i = 0; i < cfg->n_tasks; i++)
+    cl_inst_stop(cfg->insts[i]);
+  return CL_OK;
+}
+
+cl_status_t cl_config_join(struct cl_config_s *cfg, long *rets) {
+  cl_status_t status = CL_OK;
+
+  if (cfg->group)
+    return cl_group_join(cfg->group, rets);
+  for (size_t i = 0; i < cfg->n_tasks; i++)
+    if (cl_inst_join(cfg->insts[i], rets ? &rets[i] : NULL) != CL_OK)
+      status = CL_ERR_JOIN;
+  return status;
+}
+
+size_t cl_config_size(struct cl_config_s *cfg) { return cfg->n_tasks; }
+
+struct cl_instanse_s *cl_config_inst(struct cl_config_s *cfg, size_t idx) {
+  return idx < cfg->n_tasks ? cfg->insts[idx] : NULL;
+}
+
+struct cl_instanse_s *cl_config_find(struct cl_config_s *cfg,
+                                     const char *name) {
+  for (size_t i = 0; i < cfg->n_tasks; i++)
+    if (!strcmp(cfg->tasks[i].name, name))
+      return cfg->insts[i];
+  return NULL;
+}
+
+cl_status_t cl_config_destroy(struct cl_config_s *cfg) {
+  for (size_t i = 0; cfg->running && !cfg->group && i < cfg->n_tasks; i++)
+    if (!atomic_load_explicit(&cfg->insts[i]->is_joined, memory_order_relaxed))
+      return CL_ERR_BUSY;
+  if (cfg->group && cl_group_destroy(cfg->group) != CL_OK)
+    return CL_ERR_BUSY;
+  for (size_t i = 0; !cfg->group && cfg->insts && i < cfg->n_tasks; i++) {
+    if (!cfg->insts[i])
+      continue;
+    /* Instances that never started have no thread to join. */
+    atomic_store_explicit(&cfg->insts[i]->is_joined, 1, memory_order_relaxed);
+    cl_inst_destroy(cfg->insts[i]);
+  }
+  for (size_t i = 0; i < cfg->n_tasks; i++) {
+    free(cfg->tasks[i].name);
+    free(cfg->tasks[i].symbol);
+    free(cfg->tasks[i].arg);
+    free(cfg->tasks[i].library);
+    free(cfg->tasks[i].shm_name);
+  }
+  /* Task code lives in the libraries, so they go last */
+  for (size_t i = 0; i < cfg->n_libs; i++) {
+    dlclose(cfg->libs[i]);
+    free(cfg->lib_paths[i]);
+  }
+  free(cfg->lib_paths);
+  free(cfg->libs);
+  free(cfg->library);
+  free(cfg->insts);
+  free(cfg->tasks);
+  free(cfg);
+  return CL_OK;
+}
@@ -0,0 +1,311 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CL_SYSFS_CPU "/sys/devices/system/cpu"
+#define CL_LIST_LEN 4096
+
+static const char *check_names[] = {
+    "isolcpus", "nohz_full", "rcu_nocbs", "irq affinity", "governor",
+    "cpu_dma_latency",
+};
+
+static bool read_file(const char *path, char *buf, size_t size) {
+  FILE *f = fopen(path, "r");
+  size_t len;
+
+  if (!f)
+    return false;
+  len = fread(buf, 1, size - 1, f);
+  fclose(f);
+  buf[len] = '\0';
+  while (len && isspace((unsigned char)buf[len - 1]))
+    buf[--len] = '\0';
+  return true;
+}
+
+static bool write_file(const char *path, const char *str) {
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  ssize_t len = (ssize_t)strlen(str);
+  bool ok;
+
+  if (fd < 0)
+    return false;
+  ok = write(fd, str, (size_t)len) == len;
+  close(fd);
+  return ok;
+}
+
+/*
+ * Parses a kernel cpulist ("0-3,8,10-11") into @p set. False if the list
+ * does not end the string, names a CPU beyond CPU_SETSIZE or is empty.
+ */
+bool cl_parse_cpulist(const char *str, cpu_set_t *set) {
+  bool ok = true;
+  char *end;
+
+  CPU_ZERO(set);
+  while (*str) {
+    unsigned long first = strtoul(str, &end, 10), last = first;
+    if (end == str)
+      return false;
+    if (*end == '-')
+      last = strtoul(end + 1, &end, 10);
+    ok = ok && last >= first && last < CPU_SETSIZE;
+    for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+      CPU_SET(cpu, set);
+    str = *end == ',' ? end + 1 : end;
+  }
+  return ok && CPU_COUNT(set);
+}
+
+static void format_cpulist(const cpu_set_t *set, char *buf, size_t size) {
+  size_t len = 0;
+
+  buf[0] = '\0';
+  for (int cpu = 0; cpu < CPU_SETSIZE && len < size; cpu++) {
+    int last = cpu;
+    if (!CPU_ISSET(cpu, set))
+      continue;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+      last++;
+    len += (size_t)snprintf(buf + len, size - len,
+                            last > cpu ? "%s%d-%d" : "%s%d", len ? "," : "",
+                            cpu, last);
+    cpu = last;
+  }
+}
+
+/* Hex bitmap with a comma every 32 bits, as /proc/irq/default_smp_affinity. */
+static void format_hexmask(const cpu_set_t *set, char *buf, size_t size) {
+  int top = 0;
+  size_t len = 0;
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET(cpu, set))
+      top = cpu;
+  for (int word = top / 32; word >= 0 && len < size; word--) {
+    uint32_t bits = 0;
+    for (int bit = 0; bit < 32; bit++)
+      if (CPU_ISSET(word * 32 + bit, set))
+        bits |= 1U << bit;
+    len += (size_t)snprintf(buf + len, size - len,
+                            len ? ",%08x" : "%x", bits);
+  }
+}
+
+/* True if every CPU of @p mask is in @p set. */
+static bool mask_within(const cpu_set_t *mask, size_t mask_size,
+                        const cpu_set_t *set) {
+  for (size_t cpu = 0; cpu < mask_size * 8 && cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET_S(cpu, mask_size, mask) && !CPU_ISSET(cpu, set))
+      return false;
+  return true;
+}
+
+static bool mask_meets(const cpu_set_t *mask, size_t mask_size,
+                       const cpu_set_t *set) {
+  for (size_t cpu = 0; cpu < mask_size * 8 && cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET_S(cpu, mask_size, mask) && CPU_ISSET(cpu, set))
+      return true;
+  return false;
+}
+
+static bool sysfs_list_covers(const char *path, const cpu_set_t *mask,
+                              size_t mask_size) {
+  char buf[CL_LIST_LEN];
+  cpu_set_t set;
+
+  if (!read_file(path, buf, sizeof(buf)))
+    return false;
+  cl_parse_cpulist(buf, &set);
+  return mask_within(mask, mask_size, &set);
+}
+
+/* rcu_nocbs has no sysfs file; nohz_full CPUs are offloaded implicitly. */
+static bool rcu_nocbs_covers(const cpu_set_t *mask, size_t mask_size) {
+  char buf[CL_LIST_LEN];
+  const char *arg;
+  cpu_set_t set;
+
+  if (sysfs_list_covers(CL_SYSFS_CPU "/nohz_full", mask, mask_size))
+    return true;
+  if (!read_file("/proc/cmdline", buf, sizeof(buf)))
+    return false;
+  for (arg = strstr(buf, "rcu_nocbs"); arg; arg = strstr(arg + 1, "rcu_nocbs")) {
+    if (arg != buf && arg[-1] != ' ')
+      continue;
+    /* Plain "rcu_nocbs" offloads every CPU */
+    if (arg[9] == ' ' || arg[9] == '\0')
+      return true;
+    if (arg[9] != '=')
+      continue;
+    cl_parse_cpulist(arg + 10, &set);
+    return mask_within(mask, mask_size, &set);
+  }
+  return false;
+}
+
+static void check_irqs(const cpu_set_t *mask, size_t mask_size, bool enforce,
+                       cl_core_report_t *report) {
+  char path[64], buf[CL_LIST_LEN], housekeeping[CL_LIST_LEN];
+  cpu_set_t online, set;
+  struct dirent *ent;
+  DIR *dir;
+
+  if (!read_file(CL_SYSFS_CPU "/online", buf, sizeof(buf)))
+    buf[0] = '\0';
+  cl_parse_cpulist(buf, &online);
+  for (size_t cpu = 0; cpu < mask_size * 8 && cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET_S(cpu, mask_size, mask))
+      CPU_CLR(cpu, &online);
+  enforce = enforce && CPU_COUNT(&online);
+  format_cpulist(&online, housekeeping, sizeof(housekeeping));
+
+  dir = opendir("/proc/irq");
+  if (!dir) {
+    report->irqs_pinned++;
+    return;
+  }
+  while ((ent = readdir(dir))) {
+    if (!isdigit((unsigned char)ent->d_name[0]))
+      continue;
+    snprintf(path, sizeof(path), "/proc/irq/%.16s/smp_affinity_list",
+             ent->d_name);
+    if (!read_file(path, buf, sizeof(buf)))
+      continue;
+    cl_parse_cpulist(buf, &set);
+    if (!mask_meets(mask, mask_size, &set))
+      continue;
+    /* Per-CPU and managed IRQs reject the write */
+    if (enforce && write_file(path, housekeeping))
+      report->irqs_moved++;
+    else
+      report->irqs_pinned++;
+  }
+  closedir(dir);
+
+  if (enforce) {
+    format_hexmask(&online, buf, sizeof(buf));
+    write_file("/proc/irq/default_smp_affinity", buf);
+  }
+}
+
+static bool check_governor(const cpu_set_t *mask, size_t mask_size,
+                           bool enforce, bool *fixed) {
+  char path[96], buf[64];
+  bool ok = true;
+
+  for (size_t cpu = 0; cpu < mask_size * 8 && cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET_S(cpu, mask_size, mask))
+      continue;
+    snprintf(path, sizeof(path), CL_SYSFS_CPU "/cpu%zu/cpufreq/scaling_governor",
+             cpu);
+    /* No cpufreq driver, the frequency is not scaled */
+    if (!read_file(path, buf, sizeof(buf)) || !strcmp(buf, "performance"))
+      continue;
+    if (enforce && write_file(path, "performance"))
+      *fixed = true;
+    else
+      ok = false;
+  }
+  return ok;
+}
+
+static bool check_dma_latency(bool enforce, cl_core_report_t *report) {
+  int32_t val = -1, zero = 0;
+  int fd = open("/dev/cpu_dma_latency", O_RDONLY | O_CLOEXEC);
+
+  if (fd >= 0) {
+    if (read(fd, &val, sizeof(val)) != sizeof(val))
+      val = -1;
+    close(fd);
+  }
+  if (!val)
+    return true;
+  if (!enforce)
+    return false;
+  fd = open("/dev/cpu_dma_latency", O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  if (write(fd, &zero, sizeof(zero)) != sizeof(zero)) {
+    close(fd);
+    return false;
+  }
+  report->dma_latency_fd = fd;
+  report->fixed |= CL_CORE_DMA_LATENCY;
+  return true;
+}
+
+cl_status_t cl_core_prepare(const cpu_set_t *mask, size_t mask_size,
+                            unsigned check, unsigned enforce,
+                            cl_core_report_t *report) {
+  bool fixed = false;
+
+  memset(report, 0, sizeof(*report));
+  report->dma_latency_fd = -1;
+  if (!mask || !CPU_COUNT_S(mask_size, mask))
+    return CL_ERR_INVAL;
+  enforce &= check;
+
+  if ((check & CL_CORE_ISOLATED) &&
+      !sysfs_list_covers(CL_SYSFS_CPU "/isolated", mask, mask_size))
+    report->issues |= CL_CORE_ISOLATED;
+  if ((check & CL_CORE_NOHZ_FULL) &&
+      !sysfs_list_covers(CL_SYSFS_CPU "/nohz_full", mask, mask_size))
+    report->issues |= CL_CORE_NOHZ_FULL;
+  if ((check & CL_CORE_RCU_NOCBS) && !rcu_nocbs_covers(mask, mask_size))
+    report->issues |= CL_CORE_RCU_NOCBS;
+  if (check & CL_CORE_IRQ_AFFINITY) {
+    check_irqs(mask, mask_size, enforce & CL_CORE_IRQ_AFFINITY, report);
+    if (report->irqs_pinned)
+      report->issues |= CL_CORE_IRQ_AFFINITY;
+    else if (report->irqs_moved)
+      report->fixed |= CL_CORE_IRQ_AFFINITY;
+  }
+  if (check & CL_CORE_GOVERNOR) {
+    if (!check_governor(mask, mask_size, enforce & CL_CORE_GOVERNOR, &fixed))
+      report->issues |= CL_CORE_GOVERNOR;
+    else if (fixed)
+      report->fixed |= CL_CORE_GOVERNOR;
+  }
+  if ((check & CL_CORE_DMA_LATENCY) &&
+      !check_dma_latency(enforce & CL_CORE_DMA_LATENCY, report))
+    report->issues |= CL_CORE_DMA_LATENCY;
+
+  return report->issues ? CL_ERR_BUSY : CL_OK;
+}
+
+void cl_core_release(cl_core_report_t *report) {
+  if (report->dma_latency_fd >= 0)
+    close(report->dma_latency_fd);
+  report->dma_latency_fd = -1;
+}
+
+cl_status_t cl_core_verify(cl_instanse *inst) {
+  cl_core_report_t report;
+
+  /* Instances without an affinity mask have no core to verify */
+  if (!inst->attrs.core_require ||
+      cl_core_prepare(inst->attrs.cpu_mask, inst->attrs.cpu_mask_size,
+                      inst->attrs.core_require, 0, &report) != CL_ERR_BUSY)
+    return CL_OK;
+
+  fprintf(stderr, "RT core is not quiet:");
+  for (unsigned bit = 0; bit < sizeof(check_names) / sizeof(*check_names); bit++)
+    if (report.issues & (1U << bit))
+      fprintf(stderr, " %s", check_names[bit]);
+  if (report.irqs_pinned)
+    fprintf(stderr, " (%u IRQs)", report.irqs_pinned);
+  fprintf(stderr, "\n");
+  return inst->attrs.core_strict ? CL_ERR_START : CL_OK;
+}
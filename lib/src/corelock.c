@@ -1,162 +1,787 @@
 // Local headers
 #include "corelock.h"
+#include "corelock_internal.h"
 
 #include <bits/time.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <poll.h>
 #include <pthread.h>
 #include <sched.h>
 #include <stdatomic.h>
 #include <stddef.h>
-#include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <time.h>
+#include <unistd.h>
 
-#define CL_UNUSED(x) (void)(x)
+/* Timeout of a single poll() in trigger mode, rechecks the stop flag. */
+#define CL_TRIGGER_POLL_MS 100
 
-typedef struct cl_instanse_s {
-  cl_attr_t attrs;
-  cl_task task;
-  void *arg;
-  atomic_int stop_flag;
-  atomic_int is_joined;
-  atomic_int is_finished;
-  pthread_attr_t th_attr;
-  pthread_t id;
-  struct timespec start_time;
-  void (*overrun_handler)(struct cl_instanse_s *, struct timespec *,
-                          struct timespec *);
-} cl_instanse;
+/* Release lag of a yielded deadline job that triggers a resync. */
+#define CL_DL_RESYNC_NS 50000
 
-static long long diff_nsecs(struct timespec *newer, struct timespec *older) {
-  long long diff_sec = (long long)newer->tv_sec - older->tv_sec;
-  long long diff_nsec = (long long)newer->tv_nsec - older->tv_nsec;
+/* Stack kept untouched by prefaulting for the frames above thread_fn. */
+#define CL_STACK_RESERVE (16 * 1024)
 
-  if (diff_nsec < 0) {
-    diff_sec--;
-    diff_nsec += 1000000000LL;
-  }
-
-  return (diff_sec * 1000000000LL) + diff_nsec;
+static unsigned hist_bucket(long long val) {
+  unsigned bucket;
+  if (val <= 1)
+    return 0;
+  bucket = 63 - __builtin_clzll((unsigned long long)val);
+  return bucket < CL_STATS_HIST_BUCKETS ? bucket : CL_STATS_HIST_BUCKETS - 1;
 }
 
-static double seconds_from_start(cl_instanse *inst, struct timespec *curr) {
-  long long diff_sec = (long long)curr->tv_sec - inst->start_time.tv_sec;
-  long long diff_nsec = (long long)curr->tv_nsec - inst->start_time.tv_nsec;
+/*
+ * Writer side of the stats seqlock. Only the RT thread writes, so the counter
+ * needs no read-modify-write: odd while the block is being updated.
+ */
+static void stats_record(cl_instanse *inst, long long latency, long long exec,
+                         long long slack, bool overrun) {
+  unsigned seq = atomic_load_explicit(&inst->stats_seq, memory_order_relaxed);
+  cl_stats_acc *st = &inst->stats;
 
-  if (diff_nsec < 0) {
-    diff_sec--;
-    diff_nsec += 1000000000LL;
-  }
+  atomic_store_explicit(&inst->stats_seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
 
-  long long total_us = (diff_sec * 1000000LL) + (diff_nsec / 1000LL);
+  st->cycles++;
+  if (overrun)
+    st->overruns++;
+  st->skipped_periods = inst->or_state.skipped;
+  st->warmup_overruns = inst->warmup_overruns;
+  st->sync_offset_ns = inst->sync_offset_ns;
+  st->minor_faults = inst->minor_faults;
+  st->major_faults = inst->major_faults;
+  cl_stat_acc_add(&st->latency, latency);
+  cl_stat_acc_add(&st->exec, exec);
+  cl_stat_acc_add(&st->slack, slack);
+  st->latency_hist[hist_bucket(latency)]++;
+  if (inst->n_subtasks)
+    cl_subtasks_record(inst);
+  if (inst->pmc.active)
+    cl_pmc_record(inst);
 
-  return (double)total_us / 1000000.0;
+  atomic_store_explicit(&inst->stats_seq, seq + 2, memory_order_release);
 }
 
-static void overrun_handler_notify(struct cl_instanse_s *inst,
-                                   struct timespec *curr,
-                                   struct timespec *next) {
-  fprintf(stderr,
-          "Overrun is occured on %.6lf seconds from start! (overhead is %lld "
-          "nanoseconds)\n",
-          seconds_from_start(inst, curr), diff_nsecs(curr, next));
+static void emit_event(struct cl_instanse_s *inst, cl_event_type type,
+                       uint64_t curr, long long value) {
+  cl_event_t ev = {
+      .type = type,
+      .cycle = inst->cycle,
+      .timestamp_ns = cl_clock_to_mono_ns(&inst->clock, curr),
+      .value = value,
+  };
+  cl_event_emit(inst, &ev);
 }
 
-static void overrun_handler_stop(struct cl_instanse_s *inst,
-                                 struct timespec *curr, struct timespec *next) {
+static void overrun_handler_notify(struct cl_instanse_s *inst, uint64_t curr,
+                                   uint64_t *next) {
+  emit_event(inst, CL_EVENT_OVERRUN, curr,
+             cl_diff_ns(&inst->clock, curr, *next));
+}
+
+static void overrun_handler_stop(struct cl_instanse_s *inst, uint64_t curr,
+                                 uint64_t *next) {
   overrun_handler_notify(inst, curr, next);
-  fprintf(stderr, "Terminating...\n");
+  emit_event(inst, CL_EVENT_TERMINATE, curr, 0);
   atomic_store_explicit(&inst->stop_flag, 1, memory_order_relaxed);
 }
 
-static void overrun_handler_ignore(struct cl_instanse_s *inst,
-                                   struct timespec *curr,
-                                   struct timespec *next) {
+static void overrun_handler_ignore(struct cl_instanse_s *inst, uint64_t curr,
+                                   uint64_t *next) {
   CL_UNUSED(inst);
   CL_UNUSED(curr);
   CL_UNUSED(next);
   return;
 }
 
-static void align_start_time(long alignment, struct timespec *aligned_start) {
-  struct timespec curr_rt;
+static void overrun_handler_skip(struct cl_instanse_s *inst, uint64_t curr,
+                                 uint64_t *next) {
+  cl_or_realign(&inst->or_state, inst->period_ticks, curr, next);
+}
+
+static void overrun_handler_catchup(struct cl_instanse_s *inst, uint64_t curr,
+                                    uint64_t *next) {
+  cl_or_catchup(&inst->or_state, inst->attrs.or_catchup_max,
+                inst->period_ticks, curr, next);
+}
+
+static void overrun_handler_stop_after_k(struct cl_instanse_s *inst,
+                                         uint64_t curr, uint64_t *next) {
+  cl_overrun_state *st = &inst->or_state;
+  unsigned limit = inst->attrs.or_stop_limit;
+  bool stop;
+
+  overrun_handler_notify(inst, curr, next);
+  if (inst->attrs.or_stop_window) {
+    st->window[st->window_pos] = inst->cycle;
+    st->window_pos = (st->window_pos + 1) % limit;
+    if (st->window_fill < limit)
+      st->window_fill++;
+    /* After the insert window_pos is the oldest of the last `limit` overruns */
+    stop = st->window_fill == limit &&
+           inst->cycle - st->window[st->window_pos] <
+               inst->attrs.or_stop_window;
+  } else {
+    stop = ++st->consecutive >= limit;
+  }
+  if (stop) {
+    emit_event(inst, CL_EVENT_TERMINATE, curr, 0);
+    atomic_store_explicit(&inst->stop_flag, 1, memory_order_relaxed);
+  }
+}
+
+/* glibc has no sched_setattr() wrapper, layout of struct sched_attr. */
+typedef struct {
+  uint32_t size;
+  uint32_t sched_policy;
+  uint64_t sched_flags;
+  int32_t sched_nice;
+  uint32_t sched_priority;
+  uint64_t sched_runtime;
+  uint64_t sched_deadline;
+  uint64_t sched_period;
+} cl_sched_attr;
+
+/* Requests the CBS reservation of the attributes for the calling thread. */
+static bool set_deadline(const cl_attr_t *attrs, size_t period_us) {
+  size_t deadline_us = attrs->deadline_us ? attrs->deadline_us : period_us;
+  cl_sched_attr sa = {
+      .size = sizeof(sa),
+      .sched_policy = SCHED_DEADLINE,
+      .sched_runtime = (uint64_t)attrs->runtime_us * 1000,
+      .sched_deadline = (uint64_t)deadline_us * 1000,
+      .sched_period = (uint64_t)period_us * 1000,
+  };
+  return !syscall(SYS_sched_setattr, 0, &sa, 0);
+}
+
+static bool deadline_fits(const cl_attr_t *attrs, size_t period_us) {
+  size_t deadline_us = attrs->deadline_us ? attrs->deadline_us : period_us;
+  return attrs->runtime_us && attrs->runtime_us <= deadline_us &&
+         deadline_us <= period_us;
+}
+
+/*
+ * Absolute CLOCK_MONOTONIC sleep that cl_inst_stop() cuts short: the thread
+ * waits on stop_flag with FUTEX_WAIT_BITSET, whose timeout is absolute on
+ * CLOCK_MONOTONIC, and the stop wakes the futex. A raw futex is no
+ * cancellation point, so a pending cl_inst_term() is acted on once the sleep
+ * is over.
+ */
+static void sleep_until_ns(cl_instanse *inst, uint64_t ns) {
+  struct timespec ts = {.tv_sec = (time_t)(ns / 1000000000ULL),
+                        .tv_nsec = (long)(ns % 1000000000ULL)};
+
+  /* Woken, EAGAIN on a raised flag and EINTR all recheck the flag */
+  while (!atomic_load_explicit(&inst->stop_flag, memory_order_acquire))
+    if (syscall(SYS_futex, &inst->stop_flag,
+                FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, 0, &ts, NULL,
+                FUTEX_BITSET_MATCH_ANY) &&
+        errno == ETIMEDOUT)
+      break;
+  pthread_testcancel();
+}
+
+static void sleep_until(cl_instanse *inst, uint64_t deadline) {
+  sleep_until_ns(inst, cl_clock_deadline_ns(&inst->clock, deadline));
+}
+
+static void wait_handler_sleep(struct cl_instanse_s *inst, uint64_t deadline) {
+  sleep_until(inst, deadline);
+}
+
+static void wait_handler_spin(struct cl_instanse_s *inst, uint64_t deadline) {
+  while ((int64_t)(cl_clock_now(&inst->clock) - deadline) < 0 &&
+         !atomic_load_explicit(&inst->stop_flag, memory_order_relaxed))
+    cl_cpu_relax();
+}
+
+static void wait_handler_hybrid(struct cl_instanse_s *inst,
+                                uint64_t deadline) {
+  sleep_until(inst, deadline - inst->spin_margin_ticks);
+  wait_handler_spin(inst, deadline);
+}
+
+/*
+ * Under SCHED_DEADLINE the kernel throttles a yielded task until the next
+ * period of its reservation, which starts together with the loop. The
+ * reservation drifts from the loop when a replenishment comes late or the
+ * CBS wakeup rule moves it, so after a late or early return the next job
+ * blocks until its own deadline instead: a task waking past its kernel
+ * deadline gets a fresh reservation starting at the wakeup.
+ */
+static void wait_handler_yield(struct cl_instanse_s *inst, uint64_t deadline) {
+  long long drift;
+
+  if (inst->dl_resync) {
+    inst->dl_resync = false;
+    sleep_until(inst, deadline);
+    return;
+  }
+  sched_yield();
+  drift = cl_diff_ns(&inst->clock, cl_clock_now(&inst->clock), deadline);
+  if (drift < 0)
+    sleep_until(inst, deadline);
+  if (drift < 0 || drift > CL_DL_RESYNC_NS)
+    inst->dl_resync = true;
+}
+
+/*
+ * Touches every page of the range so the first cycles do not take minor
+ * faults on it. MADV_POPULATE_WRITE does so without modifying the data; the
+ * fallback rewrites each page's first byte with its own value.
+ */
+static void prefault_range(void *addr, size_t len) {
+  volatile unsigned char *ptr = addr;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(page - 1);
+
+  if (!addr || !len)
+    return;
+#ifdef MADV_POPULATE_WRITE
+  if (!madvise((void *)start, (uintptr_t)addr + len - start,
+               MADV_POPULATE_WRITE))
+    return;
+#else
+  CL_UNUSED(start);
+#endif
+  for (size_t off = 0; off < len; off += page)
+    ptr[off] = ptr[off];
+  ptr[len - 1] = ptr[len - 1];
+}
+
+__attribute__((noinline)) static void prefault_stack(size_t size) {
+  unsigned char buf[size];
+  volatile unsigned char *ptr = buf;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+  for (size_t off = 0; off < size; off += page)
+    ptr[off] = 0;
+}
+
+static void prefault_memory(cl_instanse *inst) {
+  if (inst->attrs.stack_prefault)
+    prefault_stack(inst->attrs.stack_prefault);
+  prefault_range(inst->attrs.prefault_addr, inst->attrs.prefault_len);
+  prefault_range(inst->events.buf, (inst->events.mask + 1) *
+                                       sizeof(*inst->events.buf));
+  prefault_range(inst->trace_buf,
+                 (inst->trace_mask + 1) * sizeof(*inst->trace_buf));
+}
+
+static void read_faults(long *minflt, long *majflt) {
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  *minflt = usage.ru_minflt;
+  *majflt = usage.ru_majflt;
+}
+
+static void check_faults(cl_instanse *inst, uint64_t curr) {
+  long minflt, majflt, faults;
+
+  read_faults(&minflt, &majflt);
+  faults = (minflt - inst->last_minflt) + (majflt - inst->last_majflt);
+  inst->minor_faults += (uint64_t)(minflt - inst->last_minflt);
+  inst->major_faults += (uint64_t)(majflt - inst->last_majflt);
+  inst->last_minflt = minflt;
+  inst->last_majflt = majflt;
+  if (faults)
+    emit_event(inst, CL_EVENT_PAGE_FAULTS, curr, faults);
+}
+
+/*
+ * Trigger handlers return false when the loop has to exit: stop was
+ * requested or the trigger source failed.
+ */
+static bool trigger_handler_fd(struct cl_instanse_s *inst) {
+  struct pollfd pfd[2] = {
+      {.fd = inst->attrs.trigger_fd, .events = POLLIN},
+      {.fd = inst->wake_fd, .events = POLLIN},
+  };
+  size_t size = inst->attrs.trigger_read_size ? inst->attrs.trigger_read_size
+                                              : sizeof(uint64_t);
+  unsigned char buf[sizeof(uint64_t)];
+  int ret;
+
+  for (;;) {
+    if (atomic_load_explicit(&inst->stop_flag, memory_order_acquire))
+      return false;
+    ret = poll(pfd, 2, CL_TRIGGER_POLL_MS);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret < 0 || (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL)))
+      return false;
+    /* The wake fd only fires on stop, which the next iteration sees */
+    if (pfd[0].revents & POLLIN)
+      break;
+  }
+  if (read(inst->attrs.trigger_fd, buf, size) < 0 && errno != EAGAIN)
+    return false;
+  return true;
+}
+
+static bool trigger_handler_flag(struct cl_instanse_s *inst) {
+  int *flag = inst->attrs.trigger_flag;
+
+  /* The flag is a plain int in the public API, hence the GNU builtins */
+  while (!__atomic_load_n(flag, __ATOMIC_ACQUIRE)) {
+    if (atomic_load_explicit(&inst->stop_flag, memory_order_relaxed))
+      return false;
+    cl_cpu_relax();
+  }
+  __atomic_store_n(flag, 0, __ATOMIC_RELAXED);
+  return true;
+}
+
+/*
+ * Moves the next release towards the period grid of the reference clock by at
+ * most sync_max_slew_ns. A bounded step keeps a single bad sample from
+ * disturbing the period and lets the loop follow a frequency offset.
+ */
+static void sync_adjust(cl_instanse *inst, uint64_t *next) {
+  long long offset = cl_sync_offset(inst, *next);
+  long long slew = (long long)inst->attrs.sync_max_slew_ns;
+  long long corr = offset > slew ? slew : offset < -slew ? -slew : offset;
+
+  inst->sync_offset_ns = offset;
+  if (corr >= 0)
+    *next -= cl_ns_to_ticks(&inst->clock, (uint64_t)corr);
+  else
+    *next += cl_ns_to_ticks(&inst->clock, (uint64_t)-corr);
+}
+
+static void align_start_time(long alignment) {
+  struct timespec curr_rt, aligned_start;
   clock_gettime(CLOCK_REALTIME, &curr_rt);
-  clock_gettime(CLOCK_MONOTONIC, aligned_start);
+  clock_gettime(CLOCK_MONOTONIC, &aligned_start);
 
   long offset = alignment - (curr_rt.tv_nsec % alignment);
-  aligned_start->tv_nsec += offset;
+  aligned_start.tv_nsec += offset;
 
-  while (aligned_start->tv_nsec >= 1000000000L) {
-    aligned_start->tv_sec++;
-    aligned_start->tv_nsec -= 1000000000L;
+  while (aligned_start.tv_nsec >= 1000000000L) {
+    aligned_start.tv_sec++;
+    aligned_start.tv_nsec -= 1000000000L;
   }
 
-  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, aligned_start, NULL);
-  clock_gettime(CLOCK_MONOTONIC, aligned_start);
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &aligned_start, NULL);
 }
 
-static void *thread_fn(void *inst_arg) {
-  struct timespec next_tick, curr_time;
-  cl_instanse *inst = (cl_instanse *)inst_arg;
-  double stop_time = inst->attrs.stop_time;
+/*
+ * Applies a configuration published by cl_inst_set_period() or
+ * cl_inst_set_priority(). Called on the RT thread at a cycle boundary, so the
+ * new period takes effect from the release of the current cycle and the
+ * remaining stop_time is rescaled to the new period. A deadline reservation
+ * the kernel does not admit leaves the old period in place.
+ */
+static void apply_config(cl_instanse *inst) {
+  size_t period_us =
+      atomic_exchange_explicit(&inst->pending_period_us, 0, memory_order_relaxed);
+  int priority =
+      atomic_exchange_explicit(&inst->pending_priority, -1, memory_order_relaxed);
+
+  if (period_us && period_us != inst->attrs.period_us &&
+      (inst->attrs.sched_policy != SCHED_DEADLINE ||
+       set_deadline(&inst->attrs, period_us))) {
+    if (inst->stop_cycles) {
+      uint64_t elapsed = inst->cycle + inst->or_state.skipped;
+      uint64_t left_us =
+          (inst->stop_cycles - elapsed) * (uint64_t)inst->attrs.period_us;
+      inst->stop_cycles = elapsed + (left_us + period_us - 1) / period_us;
+    }
+    inst->attrs.period_us = period_us;
+    atomic_store_explicit(&inst->trace_period_us, period_us,
+                          memory_order_relaxed);
+    inst->period_ticks = cl_ns_to_ticks(&inst->clock, period_us * 1000);
+    atomic_store_explicit(&inst->wdog_limit_ns,
+                          period_us * 1000 * inst->attrs.wdog_stall_periods,
+                          memory_order_relaxed);
+    if (inst->attrs.budget_pct)
+      cl_budget_update(inst);
+    if (inst->shm)
+      cl_shm_update(inst);
+  }
+  if (priority >= 0 && priority != inst->attrs.priority) {
+    struct sched_param param = {.sched_priority = priority};
+    if (!pthread_setschedparam(pthread_self(), inst->attrs.sched_policy,
+                               &param))
+      inst->attrs.priority = priority;
+  }
+}
+
+/*
+ * Runs the warm-up cycles paced by the period. A late warm-up cycle is only
+ * counted and the pacing restarts from the current time instead of catching
+ * up.
+ */
+static long run_warmup(cl_instanse *inst) {
+  const cl_clock *clk = &inst->clock;
+  cl_task fn = inst->attrs.warmup_fn ? inst->attrs.warmup_fn : inst->task;
+  uint64_t next = cl_clock_now(clk);
+  uint64_t now;
+  long res;
+
+  for (unsigned i = 0; i < inst->attrs.warmup_cycles; i++) {
+    if (atomic_load_explicit(&inst->stop_flag, memory_order_acquire))
+      break;
+    next += inst->period_ticks;
+    res = fn(inst->arg);
+    if (res)
+      return res;
+    now = cl_clock_now(clk);
+    if ((int64_t)(now - next) > 0) {
+      inst->warmup_overruns++;
+      next = now;
+    } else if (inst->attrs.sched_policy == SCHED_DEADLINE) {
+      /* The reservation is requested only after the warm-up */
+      sleep_until(inst, next);
+    } else {
+      inst->wait_handler(inst, next);
+    }
+  }
+  return 0;
+}
+
+/* Hands the latched start over to a CL_DEFINE_LOOP() loop. */
+static long run_loop(cl_instanse *inst) {
+  cl_loop_t *ctx = &inst->loop_ctx;
+  long res;
+
+  *ctx = (cl_loop_t){
+      .inst = inst,
+      .arg = inst->arg,
+      .stop = (const volatile int *)&inst->stop_flag,
+      .start_ns = cl_clock_to_mono_ns(&inst->clock, inst->start_tick),
+      .period_ns = (uint64_t)inst->attrs.period_us * 1000,
+      .spin_margin_ns = (uint64_t)inst->attrs.spin_margin_us * 1000,
+      .end_cycle = inst->stop_cycles ? inst->stop_cycles : UINT64_MAX,
+  };
+  res = inst->attrs.loop(ctx);
+  inst->cycle = ctx->cycle;
+  inst->or_state.skipped = ctx->skipped;
+  return res;
+}
+
+/* Specialized loops run on CLOCK_MONOTONIC, so their ns are clock ticks. */
+void cl_loop_overrun(cl_loop_t *ctx, uint64_t now_ns, uint64_t deadline_ns) {
+  ctx->inst->cycle = ctx->cycle;
+  emit_event(ctx->inst, CL_EVENT_OVERRUN, now_ns,
+             (long long)(now_ns - deadline_ns));
+}
+
+void cl_loop_terminate(cl_loop_t *ctx, uint64_t now_ns) {
+  emit_event(ctx->inst, CL_EVENT_TERMINATE, now_ns, 0);
+  atomic_store_explicit(&ctx->inst->stop_flag, 1, memory_order_relaxed);
+}
+
+void cl_loop_sleep(cl_loop_t *ctx, uint64_t ns) {
+  sleep_until_ns(ctx->inst, ns);
+}
+
+void cl_loop_finished(cl_loop_t *ctx, uint64_t now_ns, uint64_t next_ns) {
+  ctx->inst->cycle = ctx->cycle;
+  emit_event(ctx->inst, CL_EVENT_FINISHED, now_ns,
+             (long long)(next_ns - ctx->start_ns));
+}
+
+static void *run_cycles(cl_instanse *inst) {
+  const cl_clock *clk = &inst->clock;
+  uint64_t next_tick, curr_time, wake_time = 0, release = 0;
+  uint64_t period_ticks = inst->period_ticks;
+  uint64_t stop_cycles = inst->stop_cycles;
+  unsigned cfg_gen = 0, gen;
   int start_align = inst->attrs.start_align;
-  size_t periond_ns = inst->attrs.period_us * 1000;
+  bool collect_stats = inst->attrs.collect_stats;
+  bool trace = inst->trace_buf;
+  bool timing = collect_stats || trace;
+  const bool wdog = inst->attrs.wdog_stall_periods;
+  const bool budget = inst->attrs.budget_pct;
+  bool budget_timer = false;
+  bool pmc = false;
+  const bool arena_reset = inst->attrs.arena_reset_cycle && inst->arena_base;
+  const bool interpose = inst->attrs.arena_interpose;
+  const bool job = inst->job;
+  bool overrun;
+  uint64_t deadline;
+  const unsigned fault_check = inst->attrs.fault_check_cycles;
+  unsigned fault_countdown = fault_check;
+  const unsigned sync_check = inst->attrs.sync_source != CL_SYNC_NONE
+                                  ? inst->attrs.sync_interval_cycles
+                                  : 0;
+  unsigned sync_countdown = sync_check;
+  unsigned shm_check = inst->shm ? inst->shm_interval_cycles : 0;
+  unsigned shm_countdown = shm_check;
   void *res = NULL;
-  double curr_abs_stamp = 0.0;
-  const double one_tick_sec = (double)periond_ns * 1e-9;
 
-  if (start_align > 0)
-    align_start_time(start_align, &inst->start_time);
-  else
-    clock_gettime(CLOCK_MONOTONIC, &inst->start_time);
-  next_tick = inst->start_time;
+  cl_self = inst;
+  prefault_memory(inst);
+  res = (void *)run_warmup(inst);
+  if (res)
+    goto fn_out;
+  if (fault_check)
+    read_faults(&inst->last_minflt, &inst->last_majflt);
+  if (inst->gate) {
+    uint64_t release_ns;
+    inst->gate_entered = true;
+    if (!cl_gate_wait(inst->gate, &release_ns))
+      goto fn_out;
+    inst->start_tick = cl_mono_to_ticks(clk, release_ns + inst->phase_ns);
+    sleep_until(inst, inst->start_tick);
+  } else {
+    if (start_align > 0)
+      align_start_time(start_align);
+    inst->start_tick = cl_clock_now(clk);
+  }
+  if (inst->attrs.sched_policy == SCHED_DEADLINE &&
+      !set_deadline(&inst->attrs, inst->attrs.period_us)) {
+    emit_event(inst, CL_EVENT_TERMINATE, cl_clock_now(clk), 0);
+    res = (void *)(long)CL_ERR_START;
+    goto fn_out;
+  }
+  if (budget && !(budget_timer = cl_budget_start(inst))) {
+    emit_event(inst, CL_EVENT_TERMINATE, cl_clock_now(clk), 0);
+    res = (void *)(long)CL_ERR_START;
+    goto fn_out;
+  }
+  if (inst->shm)
+    cl_shm_publish(inst, CL_SHM_RUNNING);
+  if (inst->attrs.pmc_events) {
+    cl_pmc_open(inst);
+    pmc = inst->pmc.active;
+  }
+  if (inst->attrs.loop) {
+    res = (void *)run_loop(inst);
+    goto fn_out;
+  }
+  next_tick = inst->start_tick;
   while (!atomic_load_explicit(&inst->stop_flag, memory_order_acquire)) {
-    next_tick.tv_nsec += periond_ns;
-    next_tick.tv_sec += next_tick.tv_nsec / 1000000000L;
-    next_tick.tv_nsec %= 1000000000L;
+    if (inst->trigger_handler) {
+      if (!inst->trigger_handler(inst))
+        break;
+      next_tick = cl_clock_now(clk);
+    }
+    /* Release in raw ticks of the clock source (ns for CL_CLOCK_MONOTONIC) */
+    CL_PROBE2(wake, inst->cycle, next_tick);
+    if (timing) {
+      release = next_tick;
+      wake_time = cl_clock_now(clk);
+    }
+    gen = atomic_load_explicit(&inst->cfg_gen, memory_order_acquire);
+    if (gen != cfg_gen) {
+      cfg_gen = gen;
+      apply_config(inst);
+      period_ticks = inst->period_ticks;
+      stop_cycles = inst->stop_cycles;
+      if (shm_check) {
+        shm_check = inst->shm_interval_cycles;
+        if (shm_countdown > shm_check)
+          shm_countdown = shm_check;
+      }
+    }
+    next_tick += period_ticks;
+    inst->deadline_tick = next_tick;
+    if (budget)
+      cl_budget_arm(inst, next_tick - inst->budget_slack_ticks);
+    CL_PROBE1(task_enter, inst->cycle);
+    if (wdog)
+      atomic_store_explicit(&inst->heartbeat, inst->cycle * 2 + 1,
+                            memory_order_relaxed);
+    if (arena_reset)
+      inst->arena_used = 0;
+    if (interpose)
+      cl_arena_owner = inst;
+    if (pmc)
+      cl_pmc_begin(inst);
     res = (void *)inst->task(inst->arg);
+    if (!res && inst->n_subtasks)
+      res = (void *)cl_subtasks_run(inst, collect_stats);
+    if (interpose)
+      cl_arena_owner = NULL;
+    if (pmc)
+      cl_pmc_end(inst);
+    if (wdog)
+      atomic_store_explicit(&inst->heartbeat, inst->cycle * 2 + 2,
+                            memory_order_relaxed);
+    if (budget)
+      cl_budget_disarm(inst);
+    curr_time = cl_clock_now(clk);
+    CL_PROBE2(task_exit, inst->cycle, (long)res);
+    if (trace)
+      cl_trace_record(inst, release, wake_time, curr_time, (long)res);
     if (res) {
       goto fn_out;
     }
-    clock_gettime(CLOCK_MONOTONIC, &curr_time);
-    if (diff_nsecs(&curr_time, &next_tick) > 0) {
-      inst->overrun_handler(inst, &curr_time, &next_tick);
-      continue;
+    deadline = next_tick;
+    overrun = (int64_t)(curr_time - deadline) > 0;
+    if (overrun) {
+      CL_PROBE2(overrun, inst->cycle, cl_diff_ns(clk, curr_time, deadline));
+      if (trace && inst->attrs.trace_freeze_on_overrun)
+        atomic_store_explicit(&inst->trace_frozen, 1, memory_order_relaxed);
+      inst->overrun_handler(inst, curr_time, &next_tick);
+    } else {
+      inst->or_state.catchup_used = 0;
+      inst->or_state.consecutive = 0;
     }
-    if (stop_time > 0) {
-      curr_abs_stamp += one_tick_sec;
-      if (curr_abs_stamp >= stop_time - 1e-7) {
-        fprintf(stderr, "Task is finishing, duration is %.6lf\n",
-                curr_abs_stamp);
-        goto fn_out;
-      }
+    if (collect_stats)
+      stats_record(inst, cl_diff_ns(clk, wake_time, release),
+                   cl_diff_ns(clk, curr_time, wake_time),
+                   cl_diff_ns(clk, deadline, curr_time), overrun);
+    inst->cycle++;
+    if (fault_check && !--fault_countdown) {
+      check_faults(inst, curr_time);
+      fault_countdown = fault_check;
+    }
+    if (shm_check && !--shm_countdown) {
+      cl_shm_publish(inst, CL_SHM_RUNNING);
+      shm_countdown = shm_check;
+    }
+    /* Skipped periods elapsed as well, so they count towards stop_time */
+    if (stop_cycles && inst->cycle + inst->or_state.skipped >= stop_cycles) {
+      emit_event(inst, CL_EVENT_FINISHED, curr_time,
+                 cl_diff_ns(clk, next_tick, inst->start_tick));
+      goto fn_out;
+    }
+    /* Measured after the task so the syscall never delays a release */
+    if (sync_check && !--sync_countdown) {
+      sync_adjust(inst, &next_tick);
+      sync_countdown = sync_check;
+    }
+    if (!inst->trigger_handler && (int64_t)(next_tick - curr_time) >= 0) {
+      if (job)
+        cl_job_run(inst, next_tick);
+      inst->wait_handler(inst, next_tick);
     }
-    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_tick, NULL);
   }
 
 fn_out:
+  if (budget_timer)
+    cl_budget_stop(inst);
+  if (pmc)
+    cl_pmc_close(inst);
+  if (inst->shm)
+    cl_shm_publish(inst, CL_SHM_FINISHED);
+  CL_PROBE2(stop, inst->cycle, (long)res);
+  atomic_store_explicit(&inst->trace_frozen, 1, memory_order_relaxed);
+  return res;
+}
+
+/* Runs on the RT thread when the loop returns and when it is cancelled. */
+static void run_on_stop(void *inst_arg) {
+  cl_instanse *inst = (cl_instanse *)inst_arg;
+
+  /* Failed or cancelled before the gate: release the group controller */
+  if (inst->gate && !inst->gate_entered)
+    cl_gate_leave(inst->gate);
+  if (inst->attrs.on_stop)
+    inst->attrs.on_stop(inst->arg);
   atomic_store_explicit(&inst->is_finished, 1, memory_order_release);
+}
+
+static void *thread_fn(void *inst_arg) {
+  void *res;
+
+  pthread_cleanup_push(run_on_stop, inst_arg);
+  res = run_cycles((cl_instanse *)inst_arg);
+  pthread_cleanup_pop(1);
   return res;
 }
 
 struct cl_instanse_s *cl_inst_create(cl_task task, void *arg,
                                      const cl_attr_t *attrs) {
-  cl_instanse *inst = calloc(1, sizeof(*inst));
+  int node = attrs->numa_local
+                 ? cl_numa_node_of(attrs->cpu_mask, attrs->cpu_mask_size)
+                 : -1;
+  cl_instanse *inst = cl_mem_alloc(sizeof(*inst), node);
   pthread_attr_t *th_attr;
+  size_t stack_size;
   struct sched_param param = {.sched_priority = attrs->priority};
   if (!inst)
     return NULL;
+  inst->numa_node = node;
+  inst->sync_fd = -1;
+  inst->wake_fd = -1;
+  if (!cl_clock_init(&inst->clock, attrs->clock_source)) {
+    cl_mem_free(inst, sizeof(*inst), node);
+    return NULL;
+  }
 
   memcpy(&inst->attrs, attrs, sizeof(inst->attrs));
+  atomic_init(&inst->pending_priority, -1);
+  if (!cl_events_init(inst)) {
+    cl_mem_free(inst, sizeof(*inst), node);
+    return NULL;
+  }
+  if (!cl_trace_init(inst)) {
+    cl_events_free(inst);
+    cl_mem_free(inst, sizeof(*inst), node);
+    return NULL;
+  }
+  inst->period_ticks = cl_ns_to_ticks(&inst->clock, attrs->period_us * 1000);
+  inst->spin_margin_ticks =
+      cl_ns_to_ticks(&inst->clock, attrs->spin_margin_us * 1000);
+  if (attrs->stop_time > 0 && attrs->period_us &&
+      attrs->trigger == CL_TRIGGER_PERIODIC) {
+    uint64_t stop_us = (uint64_t)(attrs->stop_time * 1e6 + 0.5);
+    inst->stop_cycles = (stop_us + attrs->period_us - 1) / attrs->period_us;
+  }
+  atomic_init(&inst->trace_period_us, attrs->period_us);
+  atomic_init(&inst->wdog_limit_ns,
+              attrs->period_us * 1000 * attrs->wdog_stall_periods);
   inst->task = task;
   inst->arg = arg;
+  if (attrs->collect_stats) {
+    cl_stat_acc_reset(&inst->stats.latency);
+    cl_stat_acc_reset(&inst->stats.exec);
+    cl_stat_acc_reset(&inst->stats.slack);
+  }
 
   th_attr = &inst->th_attr;
   pthread_attr_init(th_attr);
   pthread_attr_setaffinity_np(th_attr, attrs->cpu_mask_size, attrs->cpu_mask);
-  pthread_attr_setinheritsched(th_attr, PTHREAD_EXPLICIT_SCHED);
-  pthread_attr_setschedpolicy(th_attr, attrs->sched_policy);
-  pthread_attr_setschedparam(th_attr, &param);
+  if (attrs->sched_policy == SCHED_DEADLINE) {
+    /* pthread cannot start a deadline thread, it switches itself in thread_fn */
+    if (!deadline_fits(attrs, attrs->period_us) ||
+        attrs->trigger != CL_TRIGGER_PERIODIC ||
+        attrs->sync_source != CL_SYNC_NONE)
+      goto fail;
+  } else {
+    pthread_attr_setinheritsched(th_attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(th_attr, attrs->sched_policy);
+    pthread_attr_setschedparam(th_attr, &param);
+  }
+  if (attrs->stack_size && pthread_attr_setstacksize(th_attr, attrs->stack_size))
+    goto fail;
+  /* Without stack_size the attribute reports the default stack */
+  if (attrs->stack_prefault &&
+      (pthread_attr_getstacksize(th_attr, &stack_size) ||
+       attrs->stack_prefault + CL_STACK_RESERVE > stack_size))
+    goto fail;
+  if (attrs->loop &&
+      (attrs->clock_source != CL_CLOCK_MONOTONIC ||
+       attrs->trigger != CL_TRIGGER_PERIODIC ||
+       attrs->sync_source != CL_SYNC_NONE ||
+       attrs->sched_policy == SCHED_DEADLINE || attrs->collect_stats ||
+       attrs->trace_cycles || attrs->fault_check_cycles ||
+       attrs->wdog_stall_periods || attrs->budget_pct || attrs->pmc_events ||
+       attrs->shm_name || attrs->arena_reset_cycle ||
+       attrs->arena_interpose || attrs->job_stack_size))
+    goto fail;
+  /* The job runs in the slack before a known periodic release */
+  if (attrs->job_stack_size && (attrs->trigger != CL_TRIGGER_PERIODIC ||
+                                attrs->sched_policy == SCHED_DEADLINE))
+    goto fail;
+  if (attrs->pmc_events &&
+      (!attrs->collect_stats || attrs->pmc_events >= 1U << CL_PMC_COUNT))
+    goto fail;
+  if (!cl_budget_init(inst))
+    goto fail;
 
   switch (attrs->or_bh) {
   case CL_OVERRUN_BH_NOTIFY:
@@ -168,20 +793,138 @@ struct cl_instanse_s *cl_inst_create(cl_task task, void *arg,
   case CL_OVERRUN_BH_STOP:
     inst->overrun_handler = overrun_handler_stop;
     break;
+  case CL_OVERRUN_BH_SKIP:
+    inst->overrun_handler = overrun_handler_skip;
+    break;
+  case CL_OVERRUN_BH_CATCHUP_N:
+    inst->overrun_handler = overrun_handler_catchup;
+    break;
+  case CL_OVERRUN_BH_STOP_AFTER_K:
+    if (!attrs->or_stop_limit)
+      goto fail;
+    if (attrs->or_stop_window) {
+      inst->or_state.window =
+          calloc(attrs->or_stop_limit, sizeof(*inst->or_state.window));
+      if (!inst->or_state.window)
+        goto fail;
+    }
+    inst->overrun_handler = overrun_handler_stop_after_k;
+    break;
+  }
+
+  switch (attrs->trigger) {
+  case CL_TRIGGER_PERIODIC:
+    break;
+  case CL_TRIGGER_FD:
+    if (attrs->trigger_fd < 0 || attrs->trigger_read_size > sizeof(uint64_t))
+      goto fail;
+    inst->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (inst->wake_fd < 0)
+      goto fail;
+    inst->trigger_handler = trigger_handler_fd;
+    break;
+  case CL_TRIGGER_FLAG:
+    if (!attrs->trigger_flag)
+      goto fail;
+    inst->trigger_handler = trigger_handler_flag;
+    break;
   }
 
+  if (!cl_sync_open(inst))
+    goto fail;
+  if (!cl_shm_init(inst))
+    goto fail;
+  if (!cl_arena_init(inst))
+    goto fail;
+  if (!cl_job_init(inst))
+    goto fail;
+
+  if (attrs->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE))
+    goto fail;
+
+  switch (attrs->wait_mode) {
+  case CL_WAIT_SLEEP:
+    inst->wait_handler = wait_handler_sleep;
+    break;
+  case CL_WAIT_SPIN:
+    inst->wait_handler = wait_handler_spin;
+    break;
+  case CL_WAIT_HYBRID:
+    inst->wait_handler = wait_handler_hybrid;
+    break;
+  }
+  if (attrs->sched_policy == SCHED_DEADLINE)
+    inst->wait_handler = wait_handler_yield;
+
   return inst;
+
+fail:
+  pthread_attr_destroy(th_attr);
+  free(inst->or_state.window);
+  cl_job_free(inst);
+  cl_arena_free(inst);
+  cl_shm_free(inst);
+  if (inst->wake_fd >= 0)
+    close(inst->wake_fd);
+  cl_sync_close(inst);
+  cl_trace_free(inst);
+  cl_events_free(inst);
+  cl_mem_free(inst, sizeof(*inst), inst->numa_node);
+  return NULL;
 }
 
 cl_status_t cl_inst_run(struct cl_instanse_s *inst) {
-  int res = pthread_create(&inst->id, &inst->th_attr, thread_fn, inst);
-  if (res)
+  int res;
+  if (cl_core_verify(inst) != CL_OK)
+    return CL_ERR_START;
+  cl_subtasks_prepare(inst);
+  inst->started = true;
+  if (cl_reporter_start(inst) != CL_OK)
+    return CL_ERR_START;
+  if (inst->attrs.wdog_stall_periods)
+    cl_wdog_register(inst);
+  res = pthread_create(&inst->id, &inst->th_attr, thread_fn, inst);
+  if (res) {
+    cl_wdog_unregister(inst);
+    cl_reporter_join(inst);
     return CL_ERR_START;
+  }
+  return CL_OK;
+}
+
+cl_status_t cl_inst_set_period(struct cl_instanse_s *inst, size_t period_us) {
+  if (!period_us || inst->attrs.loop)
+    return CL_ERR_INVAL;
+  if (inst->attrs.sched_policy == SCHED_DEADLINE &&
+      !deadline_fits(&inst->attrs, period_us))
+    return CL_ERR_INVAL;
+  atomic_store_explicit(&inst->pending_period_us, period_us,
+                        memory_order_relaxed);
+  atomic_fetch_add_explicit(&inst->cfg_gen, 1, memory_order_release);
+  return CL_OK;
+}
+
+cl_status_t cl_inst_set_priority(struct cl_instanse_s *inst, int priority) {
+  if (inst->attrs.sched_policy == SCHED_DEADLINE || inst->attrs.loop)
+    return CL_ERR_INVAL;
+  if (priority < sched_get_priority_min(inst->attrs.sched_policy) ||
+      priority > sched_get_priority_max(inst->attrs.sched_policy))
+    return CL_ERR_INVAL;
+  atomic_store_explicit(&inst->pending_priority, priority,
+                        memory_order_relaxed);
+  atomic_fetch_add_explicit(&inst->cfg_gen, 1, memory_order_release);
   return CL_OK;
 }
 
 cl_status_t cl_inst_stop(struct cl_instanse_s *inst) {
+  uint64_t one = 1;
+
   atomic_store_explicit(&inst->stop_flag, 1, memory_order_release);
+  /* Cut short a sleep on the flag or a poll() on the trigger fd */
+  syscall(SYS_futex, &inst->stop_flag, FUTEX_WAKE | FUTEX_PRIVATE_FLAG,
+          INT_MAX, NULL, NULL, 0);
+  if (inst->wake_fd >= 0 && write(inst->wake_fd, &one, sizeof(one)) < 0)
+    return CL_ERR_IO;
   return CL_OK;
 }
 
@@ -189,13 +932,73 @@ bool cl_inst_is_stopped(struct cl_instanse_s *inst) {
   return atomic_load_explicit(&inst->is_finished, memory_order_acquire);
 }
 
+cl_status_t cl_inst_get_stats(struct cl_instanse_s *inst, cl_stats_t *stats) {
+  cl_stats_acc snap;
+  unsigned seq;
+
+  if (!inst->attrs.collect_stats)
+    return CL_ERR_INVAL;
+
+  for (;;) {
+    seq = atomic_load_explicit(&inst->stats_seq, memory_order_acquire);
+    if (seq & 1)
+      continue;
+    memcpy(&snap, &inst->stats, sizeof(snap));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&inst->stats_seq, memory_order_relaxed) == seq)
+      break;
+  }
+
+  stats->cycles = snap.cycles;
+  stats->overruns = snap.overruns;
+  stats->skipped_periods = snap.skipped_periods;
+  stats->warmup_overruns = snap.warmup_overruns;
+  stats->sync_offset_ns = snap.sync_offset_ns;
+  stats->minor_faults = snap.minor_faults;
+  stats->major_faults = snap.major_faults;
+  cl_stat_from_acc(&stats->wakeup_latency, &snap.latency, snap.cycles);
+  cl_stat_from_acc(&stats->exec_time, &snap.exec, snap.cycles);
+  cl_stat_from_acc(&stats->slack, &snap.slack, snap.cycles);
+  memcpy(stats->latency_hist, snap.latency_hist, sizeof(stats->latency_hist));
+  cl_pmc_stats(stats, &snap);
+  return CL_OK;
+}
+
+static void joined(cl_instanse *inst, void *th_ret, long *ret) {
+  cl_wdog_unregister(inst);
+  cl_reporter_join(inst);
+  cl_trace_flush(inst);
+  if (ret)
+    *ret = (long)th_ret;
+  atomic_store_explicit(&inst->is_joined, 1, memory_order_relaxed);
+}
+
 cl_status_t cl_inst_join(struct cl_instanse_s *inst, long *ret) {
   void *th_ret;
   if (pthread_join(inst->id, &th_ret))
     return CL_ERR_JOIN;
-  if (ret)
-    *ret = (long)th_ret;
-  atomic_store_explicit(&inst->is_joined, 1, memory_order_relaxed);
+  joined(inst, th_ret, ret);
+  return CL_OK;
+}
+
+cl_status_t cl_inst_join_timeout(struct cl_instanse_s *inst, size_t timeout_us,
+                                 long *ret) {
+  struct timespec ts;
+  uint64_t ns;
+  void *th_ret;
+  int res;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec +
+       (uint64_t)timeout_us * 1000;
+  ts.tv_sec = (time_t)(ns / 1000000000ULL);
+  ts.tv_nsec = (long)(ns % 1000000000ULL);
+  res = pthread_clockjoin_np(inst->id, &th_ret, CLOCK_MONOTONIC, &ts);
+  if (res == ETIMEDOUT)
+    return CL_ERR_BUSY;
+  if (res)
+    return CL_ERR_JOIN;
+  joined(inst, th_ret, ret);
   return CL_OK;
 }
 
@@ -210,6 +1013,16 @@ cl_status_t cl_inst_destroy(struct cl_instanse_s *inst) {
     return CL_ERR_BUSY;
   }
   pthread_attr_destroy(&inst->th_attr);
-  free(inst);
+  free(inst->or_state.window);
+  cl_subtasks_free(inst);
+  cl_job_free(inst);
+  cl_arena_free(inst);
+  cl_shm_free(inst);
+  if (inst->wake_fd >= 0)
+    close(inst->wake_fd);
+  cl_sync_close(inst);
+  cl_trace_free(inst);
+  cl_events_free(inst);
+  cl_mem_free(inst, sizeof(*inst), inst->numa_node);
   return CL_OK;
 }
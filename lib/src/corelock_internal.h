@@ -0,0 +1,568 @@
+#ifndef CORELOCK_INTERNAL_H
+#define CORELOCK_INTERNAL_H
+
+#include "corelock.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define CL_UNUSED(x) (void)(x)
+
+/*
+ * USDT probes of the task loop (provider "corelock"), enabled with the
+ * CORELOCK_USDT CMake option. Unattached probes are a single nop; with the
+ * option off they compile to nothing.
+ */
+#ifdef CL_USDT
+#include <sys/sdt.h>
+#define CL_PROBE1(name, a) STAP_PROBE1(corelock, name, a)
+#define CL_PROBE2(name, a, b) STAP_PROBE2(corelock, name, a, b)
+#else
+#define CL_PROBE1(name, a)                                                     \
+  do {                                                                         \
+  } while (0)
+#define CL_PROBE2(name, a, b)                                                  \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#define CL_CACHE_LINE 64
+
+__extension__ typedef unsigned __int128 cl_u128;
+__extension__ typedef __int128 cl_s128;
+
+/*
+ * Raw time source of an instance. Deadlines are kept in source ticks; ticks
+ * relate to CLOCK_MONOTONIC nanoseconds through a 32.32 fixed-point ratio
+ * anchored at (base_ticks, base_ns). For CL_CLOCK_MONOTONIC ticks are ns.
+ */
+typedef struct {
+  cl_clock_source source;
+  uint64_t base_ticks;
+  uint64_t base_ns;
+  uint64_t ns_mult;
+  uint64_t tick_mult;
+  /* Anchor of the sleep deadlines, re-read at resync_tick. RT thread only. */
+  uint64_t sync_ticks;
+  uint64_t sync_ns;
+  uint64_t resync_tick;
+} cl_clock;
+
+typedef struct {
+  long long min;
+  long long max;
+  long long sum;
+} cl_stat_acc;
+
+typedef struct {
+  unsigned long long cycles;
+  unsigned long long overruns;
+  unsigned long long skipped_periods;
+  unsigned long long warmup_overruns;
+  long long sync_offset_ns;
+  unsigned long long minor_faults;
+  unsigned long long major_faults;
+  cl_stat_acc latency;
+  cl_stat_acc exec;
+  cl_stat_acc slack;
+  unsigned long long latency_hist[CL_STATS_HIST_BUCKETS];
+  unsigned pmc_events;
+  cl_stat_acc pmc[CL_PMC_COUNT];
+} cl_stats_acc;
+
+/* Performance counters of the RT thread, RT thread only. */
+typedef struct {
+  unsigned active;
+  int fd[CL_PMC_COUNT];
+  void *page[CL_PMC_COUNT];
+  uint64_t start[CL_PMC_COUNT];
+  uint64_t delta[CL_PMC_COUNT];
+} cl_pmc;
+
+/* Subtask of the chain; countdown reaches 0 in the cycles it is due. */
+typedef struct {
+  cl_task fn;
+  void *arg;
+  unsigned divisor;
+  unsigned phase;
+  unsigned countdown;
+  /* Exec time of the current cycle waiting for stats_record(), -1 if none. */
+  long long pending_exec;
+} cl_subtask;
+
+typedef struct {
+  unsigned long long runs;
+  cl_stat_acc exec;
+} cl_subtask_acc;
+
+/* Overrun policy bookkeeping, touched by the RT thread only. */
+typedef struct {
+  uint64_t skipped;
+  unsigned consecutive;
+  unsigned catchup_used;
+  /* Cycle indices of the last or_stop_limit overruns (sliding window). */
+  uint64_t *window;
+  unsigned window_pos;
+  unsigned window_fill;
+} cl_overrun_state;
+
+/*
+ * Single-producer (RT thread) / single-consumer event ring. Head and tail
+ * live on separate cache lines so that producer and consumer do not share one.
+ */
+typedef struct {
+  cl_event_t *buf;
+  size_t mask;
+  alignas(CL_CACHE_LINE) atomic_size_t head;
+  atomic_ullong dropped;
+  alignas(CL_CACHE_LINE) atomic_size_t tail;
+} cl_event_ring;
+
+/* Flight recorder slot, raw clock ticks until the dump. */
+typedef struct {
+  uint64_t cycle;
+  uint64_t release;
+  uint64_t wake;
+  uint64_t end;
+  int64_t ret;
+} cl_trace_slot;
+
+/*
+ * Start gate of a group: threads park here until the controller publishes the
+ * common release instant (CLOCK_MONOTONIC ns) or aborts the start.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t ready;
+  size_t expected;
+  bool released;
+  bool aborted;
+  uint64_t release_ns;
+} cl_gate;
+
+/* Background job slot, see job.c. */
+typedef struct cl_job_s cl_job;
+
+/*
+ * The instance is split into cache-line aligned blocks by who writes them,
+ * so that the control thread and the RT core do not bounce a line between
+ * them on every cycle.
+ */
+typedef struct cl_instanse_s {
+  /* RT block: written before the thread starts or by the RT thread only. */
+  alignas(CL_CACHE_LINE) cl_task task;
+  void *arg;
+  void (*overrun_handler)(struct cl_instanse_s *, uint64_t, uint64_t *);
+  void (*wait_handler)(struct cl_instanse_s *, uint64_t);
+  /* Blocks until the next external release; NULL in periodic mode. */
+  bool (*trigger_handler)(struct cl_instanse_s *);
+  cl_clock clock;
+  uint64_t period_ticks;
+  uint64_t spin_margin_ticks;
+  uint64_t start_tick;
+  /* Number of cycles to run, derived from stop_time. 0 means infinite. */
+  uint64_t stop_cycles;
+  uint64_t cycle;
+  cl_overrun_state or_state;
+  uint64_t warmup_overruns;
+  /* Page fault counters of the RT thread, RT thread only. */
+  long last_minflt;
+  long last_majflt;
+  uint64_t minor_faults;
+  uint64_t major_faults;
+  /* Reference clock for phase locking. */
+  clockid_t sync_clock;
+  int sync_fd;
+  long long sync_offset_ns;
+  /* SCHED_DEADLINE: block instead of yielding to realign the reservation. */
+  bool dl_resync;
+  /* Subtask chain and its statistics (written under stats_seq). */
+  cl_subtask *subtasks;
+  cl_subtask_acc *subtask_stats;
+  size_t n_subtasks;
+  /* State of a CL_DEFINE_LOOP() loop, owned by it while it runs. */
+  cl_loop_t loop_ctx;
+  /* Deadline of the current cycle, read by cl_remaining_ns(). */
+  uint64_t deadline_tick;
+  /* Soft deadline timer; it fires budget_slack_ticks before the deadline. */
+  timer_t budget_timer;
+  uint64_t budget_slack_ticks;
+  /* Set by the timer signal, which runs on the RT thread. */
+  atomic_int budget_expired;
+  cl_pmc pmc;
+  /* Background job resumed in the slack, NULL if disabled. */
+  cl_job *job;
+  /* Allocation arena, NULL if disabled. */
+  unsigned char *arena_base;
+  size_t arena_used;
+  /* Shared memory status segment, NULL if disabled. */
+  cl_shm_status_t *shm;
+  unsigned shm_interval_cycles;
+  /* Flight recorder ring, NULL if disabled. */
+  cl_trace_slot *trace_buf;
+  size_t trace_mask;
+  /* attrs.period_us as published by the RT thread for the dump. */
+  atomic_size_t trace_period_us;
+  cl_attr_t attrs;
+
+  /* Control block: written by non-RT threads, polled by the RT thread. */
+  alignas(CL_CACHE_LINE) atomic_int stop_flag;
+  /* Eventfd that cuts a trigger wait short on stop, -1 if unused. */
+  int wake_fd;
+  atomic_int is_joined;
+  atomic_int reporter_stop;
+  /* Runtime reconfiguration, picked up when cfg_gen changes. */
+  atomic_uint cfg_gen;
+  atomic_size_t pending_period_us;
+  atomic_int pending_priority;
+  atomic_int trace_frozen;
+
+  /* Status block: written by the RT thread, read by other threads. */
+  alignas(CL_CACHE_LINE) atomic_int is_finished;
+  atomic_uint stats_seq;
+  cl_stats_acc stats;
+  /* Number of trace records written so far. */
+  atomic_size_t trace_head;
+  /* Watchdog heartbeat: 2 * cycle, +1 while the task of that cycle runs. */
+  atomic_ullong heartbeat;
+  atomic_ullong wdog_limit_ns;
+  atomic_size_t arena_peak;
+  atomic_ullong arena_fallbacks;
+
+  cl_event_ring events;
+
+  /* Cold block: thread management, not touched in the loop. */
+  alignas(CL_CACHE_LINE) pthread_attr_t th_attr;
+  pthread_t id;
+  pthread_t reporter;
+  bool reporter_running;
+  cl_gate *gate;
+  /* Set once the RT thread has checked in at the gate. */
+  bool gate_entered;
+  uint64_t phase_ns;
+  /* NUMA node the instance memory is bound to, -1 for the default policy. */
+  int numa_node;
+  bool started;
+  /* Set once the frozen recorder went to trace_path. */
+  atomic_int trace_dumped;
+  /* Watchdog list entry and stall tracking, guarded by the watchdog lock. */
+  struct cl_instanse_s *wdog_next;
+  unsigned long long wdog_seen;
+  uint64_t wdog_since_ns;
+  uint64_t wdog_stalled_ns;
+  struct cl_instanse_s *wdog_pending_next;
+  bool wdog_fired;
+  bool wdog_registered;
+} cl_instanse;
+
+static inline size_t cl_round_up_pow2(size_t val) {
+  size_t res = 1;
+  while (res < val)
+    res <<= 1;
+  return res;
+}
+
+static inline uint64_t cl_mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t cl_counter_read(void) {
+#if defined(__x86_64__)
+  unsigned aux;
+  return __builtin_ia32_rdtscp(&aux);
+#elif defined(__aarch64__)
+  uint64_t val;
+  __asm__ __volatile__("isb\n\tmrs %0, cntvct_el0" : "=r"(val)::"memory");
+  return val;
+#else
+  return cl_mono_ns();
+#endif
+}
+
+static inline uint64_t cl_clock_now(const cl_clock *clk) {
+  if (clk->source == CL_CLOCK_CPU_COUNTER)
+    return cl_counter_read();
+  return cl_mono_ns();
+}
+
+/* Converts a signed tick delta to nanoseconds. */
+static inline long long cl_ticks_to_ns(const cl_clock *clk, int64_t ticks) {
+  return (long long)(((cl_s128)ticks * (cl_s128)clk->ns_mult) >> 32);
+}
+
+static inline uint64_t cl_ns_to_ticks(const cl_clock *clk, uint64_t ns) {
+  return (uint64_t)(((cl_u128)ns * clk->tick_mult) >> 32);
+}
+
+/* Maps an absolute tick value to CLOCK_MONOTONIC nanoseconds. */
+static inline uint64_t cl_clock_to_mono_ns(const cl_clock *clk,
+                                           uint64_t ticks) {
+  return clk->base_ns +
+         (uint64_t)cl_ticks_to_ns(clk, (int64_t)(ticks - clk->base_ticks));
+}
+
+/* Re-reads the sleep anchor of a counter clock (clock.c). */
+void cl_clock_resync(cl_clock *clk);
+
+/*
+ * CLOCK_MONOTONIC time to sleep until for an absolute tick deadline. NTP
+ * slews CLOCK_MONOTONIC but not the counter, so the fixed base of
+ * cl_clock_to_mono_ns() drifts over a long run; the deadline is converted
+ * from the sync anchor instead, which is re-read every CL_CLOCK_RESYNC_NS.
+ */
+static inline uint64_t cl_clock_deadline_ns(cl_clock *clk, uint64_t ticks) {
+  if (clk->source != CL_CLOCK_CPU_COUNTER)
+    return ticks;
+  if ((int64_t)(ticks - clk->resync_tick) >= 0)
+    cl_clock_resync(clk);
+  return clk->sync_ns +
+         (uint64_t)cl_ticks_to_ns(clk, (int64_t)(ticks - clk->sync_ticks));
+}
+
+/* Maps CLOCK_MONOTONIC nanoseconds to an absolute tick value. */
+static inline uint64_t cl_mono_to_ticks(const cl_clock *clk, uint64_t ns) {
+  return clk->base_ticks + cl_ns_to_ticks(clk, ns - clk->base_ns);
+}
+
+/* Signed difference newer - older in nanoseconds. */
+static inline long long cl_diff_ns(const cl_clock *clk, uint64_t newer,
+                                   uint64_t older) {
+  return cl_ticks_to_ns(clk, (int64_t)(newer - older));
+}
+
+/* Moves the deadline *next to the first period boundary after curr. */
+static inline void cl_or_realign(cl_overrun_state *st, uint64_t period,
+                                 uint64_t curr, uint64_t *next) {
+  uint64_t missed = (curr - *next) / period + 1;
+  *next += missed * period;
+  st->skipped += missed;
+}
+
+/*
+ * CL_OVERRUN_BH_CATCHUP_N: keeps the deadline for up to max late cycles in a
+ * row, then realigns it and starts a new budget.
+ */
+static inline void cl_or_catchup(cl_overrun_state *st, unsigned max,
+                                 uint64_t period, uint64_t curr,
+                                 uint64_t *next) {
+  if (st->catchup_used < max) {
+    st->catchup_used++;
+    return;
+  }
+  st->catchup_used = 0;
+  cl_or_realign(st, period, curr, next);
+}
+
+static inline void cl_stat_acc_reset(cl_stat_acc *acc) {
+  acc->min = LLONG_MAX;
+  acc->max = LLONG_MIN;
+  acc->sum = 0;
+}
+
+static inline void cl_stat_acc_add(cl_stat_acc *acc, long long val) {
+  if (val < acc->min)
+    acc->min = val;
+  if (val > acc->max)
+    acc->max = val;
+  acc->sum += val;
+}
+
+static inline void cl_stat_from_acc(cl_stat_t *out, const cl_stat_acc *acc,
+                                    unsigned long long cycles) {
+  if (!cycles) {
+    memset(out, 0, sizeof(*out));
+    return;
+  }
+  out->min_ns = acc->min;
+  out->max_ns = acc->max;
+  out->mean_ns = acc->sum / (long long)cycles;
+}
+
+/**
+ * Calibrates @p clk against CLOCK_MONOTONIC. Returns false if @p source is
+ * not usable on this machine (e.g. no invariant TSC).
+ */
+bool cl_clock_init(cl_clock *clk, cl_clock_source source);
+
+/*
+ * Returns the NUMA node of the first CPU in @p mask, or -1 if it cannot be
+ * determined.
+ */
+int cl_numa_node_of(const cpu_set_t *mask, size_t mask_size);
+
+/*
+ * Zeroed, cache-line aligned allocation. With @p node >= 0 the pages are
+ * mapped separately and bound to that NUMA node.
+ */
+void *cl_mem_alloc(size_t size, int node);
+void cl_mem_free(void *ptr, size_t size, int node);
+
+/* Allocates the event ring if requested by the attributes. */
+bool cl_events_init(cl_instanse *inst);
+void cl_events_free(cl_instanse *inst);
+
+/*
+ * Queues @p ev into the event ring, or prints it to stderr right away if the
+ * ring is disabled.
+ */
+void cl_event_emit(cl_instanse *inst, const cl_event_t *ev);
+
+/*
+ * Parks the calling RT thread until the gate is released. Returns false if
+ * the start was aborted.
+ */
+bool cl_gate_wait(cl_gate *gate, uint64_t *release_ns);
+
+/*
+ * Checks in a thread that exits before reaching the gate and aborts the
+ * start, so the controller does not wait for it forever.
+ */
+void cl_gate_leave(cl_gate *gate);
+
+/*
+ * Opens the reference clock of the attributes and resolves the sync defaults.
+ * Returns false if the clock cannot be read.
+ */
+bool cl_sync_open(cl_instanse *inst);
+void cl_sync_close(cl_instanse *inst);
+
+/*
+ * Signed distance in ns of the local tick @p release from the nearest period
+ * boundary of the reference clock; positive when the release is late.
+ */
+long long cl_sync_offset(cl_instanse *inst, uint64_t release);
+
+/* Allocates the flight recorder if requested by the attributes. */
+bool cl_trace_init(cl_instanse *inst);
+void cl_trace_free(cl_instanse *inst);
+
+/*
+ * Writes a frozen recorder to trace_path once, from a non-RT thread. Does
+ * nothing if the recorder is disabled, running or already dumped.
+ */
+void cl_trace_flush(cl_instanse *inst);
+
+/* Hot path of the recorder: plain stores and one release store of head. */
+static inline void cl_trace_record(cl_instanse *inst, uint64_t release,
+                                   uint64_t wake, uint64_t end, long ret) {
+  size_t head;
+  cl_trace_slot *slot;
+
+  if (atomic_load_explicit(&inst->trace_frozen, memory_order_relaxed))
+    return;
+  head = atomic_load_explicit(&inst->trace_head, memory_order_relaxed);
+  slot = &inst->trace_buf[head & inst->trace_mask];
+  slot->cycle = inst->cycle;
+  slot->release = release;
+  slot->wake = wake;
+  slot->end = end;
+  slot->ret = ret;
+  atomic_store_explicit(&inst->trace_head, head + 1, memory_order_release);
+}
+
+/* Resolves automatic subtask phases and arms the countdowns. */
+void cl_subtasks_prepare(cl_instanse *inst);
+void cl_subtasks_free(cl_instanse *inst);
+
+/* Runs the subtasks due in this cycle, returns the first non-zero result. */
+long cl_subtasks_run(cl_instanse *inst, bool timed);
+
+/* Folds the pending subtask exec times into their stats. Seqlock writer. */
+void cl_subtasks_record(cl_instanse *inst);
+
+/*
+ * Inspects the cores of the instance for cl_attr_t.core_require and reports
+ * failures on stderr. Returns CL_ERR_START if they fail with core_strict.
+ */
+cl_status_t cl_core_verify(cl_instanse *inst);
+
+/* Kernel cpulist syntax ("0-3,8"), also used by the config loader. */
+bool cl_parse_cpulist(const char *str, cpu_set_t *set);
+
+/* Instance of the calling RT thread, NULL on other threads. */
+extern _Thread_local cl_instanse *cl_self;
+
+/*
+ * Soft deadline of the attributes. init resolves the defaults and installs
+ * the signal handler, start creates the timer on the RT thread and update
+ * follows a period change.
+ */
+bool cl_budget_init(cl_instanse *inst);
+bool cl_budget_start(cl_instanse *inst);
+void cl_budget_stop(cl_instanse *inst);
+void cl_budget_update(cl_instanse *inst);
+
+/* Arms the soft deadline timer at the absolute tick @p expiry. */
+void cl_budget_arm(cl_instanse *inst, uint64_t expiry);
+void cl_budget_disarm(cl_instanse *inst);
+
+/*
+ * Opens the cl_attr_t.pmc_events counters for the calling RT thread and
+ * publishes the available ones in the stats.
+ */
+void cl_pmc_open(cl_instanse *inst);
+void cl_pmc_close(cl_instanse *inst);
+
+/* Counter reads around the task; the deltas wait for cl_pmc_record(). */
+void cl_pmc_begin(cl_instanse *inst);
+void cl_pmc_end(cl_instanse *inst);
+
+/* Folds the deltas of the cycle into the stats. Seqlock writer. */
+void cl_pmc_record(cl_instanse *inst);
+void cl_pmc_stats(cl_stats_t *stats, const cl_stats_acc *snap);
+
+/*
+ * Creates the status segment of cl_attr_t.shm_name. Returns false if a live
+ * process owns it or it cannot be created or mapped. update recomputes the
+ * publish interval in cycles after a period change.
+ */
+bool cl_shm_init(cl_instanse *inst);
+void cl_shm_free(cl_instanse *inst);
+void cl_shm_update(cl_instanse *inst);
+
+/* Copies the state of the instance into its segment. RT thread only. */
+void cl_shm_publish(cl_instanse *inst, cl_shm_state state);
+
+/* Instance whose arena serves malloc() while its task runs (arena_hook.c). */
+extern _Thread_local cl_instanse *cl_arena_owner;
+
+/* Allocates and locks the arena of the attributes. */
+bool cl_arena_init(cl_instanse *inst);
+void cl_arena_free(cl_instanse *inst);
+
+/*
+ * Bump allocation with a power of two @p align; NULL (counted as a fallback)
+ * if the arena is full.
+ */
+void *cl_arena_take(cl_instanse *inst, size_t size, size_t align);
+
+/* Registers the arena range with the malloc interposer (CL_MALLOC_HOOK). */
+bool cl_arena_hook_add(cl_instanse *inst);
+void cl_arena_hook_remove(cl_instanse *inst);
+
+/* Allocates the job slot and its stack for cl_attr_t.job_stack_size. */
+bool cl_job_init(cl_instanse *inst);
+void cl_job_free(cl_instanse *inst);
+
+/*
+ * Resumes a submitted job until it yields past @p next_tick minus the job
+ * margin or returns. RT thread only.
+ */
+void cl_job_run(cl_instanse *inst, uint64_t next_tick);
+
+/* Adds the instance to the watchdog list, from cl_inst_run() to join. */
+void cl_wdog_register(cl_instanse *inst);
+void cl_wdog_unregister(cl_instanse *inst);
+
+cl_status_t cl_reporter_start(cl_instanse *inst);
+void cl_reporter_join(cl_instanse *inst);
+
+#endif // CORELOCK_INTERNAL_H
@@ -0,0 +1,187 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CL_REPORTER_INTERVAL_NS 10000000L
+#define CL_REPORTER_BATCH 64
+
+static void event_print(cl_instanse *inst, const cl_event_t *ev) {
+  uint64_t start_ns = cl_clock_to_mono_ns(&inst->clock, inst->start_tick);
+
+  switch (ev->type) {
+  case CL_EVENT_OVERRUN:
+    fprintf(stderr,
+            "Overrun is occured on %.6lf seconds from start! (overhead is %lld "
+            "nanoseconds)\n",
+            (double)(long long)(ev->timestamp_ns - start_ns) / 1e9,
+            ev->value);
+    break;
+  case CL_EVENT_TASK_OVERRUN:
+    fprintf(stderr,
+            "Overrun of executor task %zu in frame %llu! (overhead is %lld "
+            "nanoseconds)\n",
+            ev->task_index, ev->cycle, ev->value);
+    break;
+  case CL_EVENT_TERMINATE:
+    fprintf(stderr, "Terminating...\n");
+    break;
+  case CL_EVENT_PAGE_FAULTS:
+    fprintf(stderr, "%lld page faults in the hot loop before cycle %llu!\n",
+            ev->value, ev->cycle);
+    break;
+  case CL_EVENT_FINISHED:
+    fprintf(stderr, "Task is finishing, duration is %.6lf\n",
+            (double)ev->value / 1e9);
+    break;
+  }
+}
+
+bool cl_events_init(cl_instanse *inst) {
+  size_t size = inst->attrs.event_ring_size;
+  if (!size)
+    return true;
+  size = cl_round_up_pow2(size);
+  inst->events.buf =
+      cl_mem_alloc(size * sizeof(*inst->events.buf), inst->numa_node);
+  if (!inst->events.buf)
+    return false;
+  inst->events.mask = size - 1;
+  return true;
+}
+
+void cl_events_free(cl_instanse *inst) {
+  cl_mem_free(inst->events.buf,
+              (inst->events.mask + 1) * sizeof(*inst->events.buf),
+              inst->numa_node);
+  inst->events.buf = NULL;
+}
+
+void cl_event_emit(cl_instanse *inst, const cl_event_t *ev) {
+  cl_event_ring *ring = &inst->events;
+  size_t head, tail;
+
+  if (!ring->buf) {
+    event_print(inst, ev);
+    return;
+  }
+
+  head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head - tail > ring->mask) {
+    atomic_store_explicit(
+        &ring->dropped,
+        atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+        memory_order_relaxed);
+    return;
+  }
+  ring->buf[head & ring->mask] = *ev;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+size_t cl_inst_drain_events(struct cl_instanse_s *inst, cl_event_t *events,
+                            size_t max) {
+  cl_event_ring *ring = &inst->events;
+  size_t head, tail, count;
+
+  if (!ring->buf)
+    return 0;
+
+  tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  count = head - tail < max ? head - tail : max;
+  for (size_t i = 0; i < count; i++)
+    events[i] = ring->buf[(tail + i) & ring->mask];
+  atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+  return count;
+}
+
+unsigned long long cl_inst_events_dropped(struct cl_instanse_s *inst) {
+  return atomic_load_explicit(&inst->events.dropped, memory_order_relaxed);
+}
+
+static void reporter_flush(cl_instanse *inst, unsigned long long *dropped) {
+  cl_event_t batch[CL_REPORTER_BATCH];
+  unsigned long long curr_dropped;
+  size_t count;
+
+  while ((count = cl_inst_drain_events(inst, batch, CL_REPORTER_BATCH)))
+    for (size_t i = 0; i < count; i++)
+      event_print(inst, &batch[i]);
+
+  curr_dropped = cl_inst_events_dropped(inst);
+  if (curr_dropped != *dropped) {
+    fprintf(stderr, "%llu events were dropped, event ring is full\n",
+            curr_dropped - *dropped);
+    *dropped = curr_dropped;
+  }
+}
+
+static void *reporter_fn(void *inst_arg) {
+  cl_instanse *inst = inst_arg;
+  struct timespec interval = {.tv_sec = 0, .tv_nsec = CL_REPORTER_INTERVAL_NS};
+  unsigned long long dropped = 0;
+
+  while (!atomic_load_explicit(&inst->reporter_stop, memory_order_acquire)) {
+    reporter_flush(inst, &dropped);
+    /* A recorder frozen by an overrun is dumped without waiting for join */
+    cl_trace_flush(inst);
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
+  }
+  reporter_flush(inst, &dropped);
+  return NULL;
+}
+
+/*
+ * The reporter is a SCHED_OTHER thread on the CPUs of the process outside
+ * cpu_mask, whatever the policy and affinity of the caller.
+ */
+static void reporter_attr(const cl_attr_t *attrs, pthread_attr_t *th_attr) {
+  struct sched_param param = {.sched_priority = 0};
+  cpu_set_t cpus;
+
+  pthread_attr_init(th_attr);
+  pthread_attr_setinheritsched(th_attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(th_attr, SCHED_OTHER);
+  pthread_attr_setschedparam(th_attr, &param);
+  if (sched_getaffinity(getpid(), sizeof(cpus), &cpus))
+    return;
+  for (size_t cpu = 0; attrs->cpu_mask && cpu < attrs->cpu_mask_size * 8 &&
+                       cpu < CPU_SETSIZE;
+       cpu++)
+    if (CPU_ISSET_S(cpu, attrs->cpu_mask_size, attrs->cpu_mask))
+      CPU_CLR(cpu, &cpus);
+  /* With no CPU left it keeps the affinity of the caller */
+  if (CPU_COUNT(&cpus))
+    pthread_attr_setaffinity_np(th_attr, sizeof(cpus), &cpus);
+}
+
+cl_status_t cl_reporter_start(cl_instanse *inst) {
+  pthread_attr_t th_attr;
+  int err;
+
+  if (!inst->events.buf || !inst->attrs.event_reporter)
+    return CL_OK;
+  atomic_store_explicit(&inst->reporter_stop, 0, memory_order_relaxed);
+  reporter_attr(&inst->attrs, &th_attr);
+  err = pthread_create(&inst->reporter, &th_attr, reporter_fn, inst);
+  pthread_attr_destroy(&th_attr);
+  if (err)
+    return CL_ERR_START;
+  inst->reporter_running = true;
+  return CL_OK;
+}
+
+void cl_reporter_join(cl_instanse *inst) {
+  if (!inst->reporter_running)
+    return;
+  atomic_store_explicit(&inst->reporter_stop, 1, memory_order_release);
+  pthread_join(inst->reporter, NULL);
+  inst->reporter_running = false;
+}
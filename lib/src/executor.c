@@ -0,0 +1,222 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  cl_task task;
+  void *arg;
+  size_t period_us;
+  cl_overrun_bh or_bh;
+  unsigned or_stop_limit;
+  unsigned consecutive;
+  /* Period expressed in minor frames and frames left until next release. */
+  unsigned long long divisor;
+  unsigned long long countdown;
+} cl_exec_task;
+
+typedef struct cl_executor_s {
+  cl_attr_t attrs;
+  cl_exec_task *tasks;
+  size_t n_tasks;
+  size_t minor_us;
+  unsigned long long frame;
+  /* Set by warm-up frames, the first measured frame restarts the schedule. */
+  bool warming;
+  struct cl_instanse_s *inst;
+} cl_executor;
+
+static size_t gcd(size_t a, size_t b) {
+  while (b) {
+    size_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static int cmp_period(const void *lhs, const void *rhs) {
+  const cl_exec_task *a = lhs;
+  const cl_exec_task *b = rhs;
+  return (a->period_us > b->period_us) - (a->period_us < b->period_us);
+}
+
+static void restart_schedule(cl_executor *exec) {
+  exec->frame = 0;
+  for (size_t i = 0; i < exec->n_tasks; i++)
+    exec->tasks[i].countdown = 1;
+}
+
+/* Releases of the frame are only checked once start_tick is latched. */
+static long run_frame(cl_executor *exec, bool check) {
+  const cl_clock *clk = &exec->inst->clock;
+  uint64_t frame_ticks = exec->inst->period_ticks;
+  uint64_t release = exec->inst->start_tick + exec->frame * frame_ticks;
+  uint64_t now, deadline;
+  cl_event_t ev;
+  long res;
+
+  exec->frame++;
+
+  for (size_t i = 0; i < exec->n_tasks; i++) {
+    cl_exec_task *t = &exec->tasks[i];
+    if (--t->countdown)
+      continue;
+    t->countdown = t->divisor;
+
+    res = t->task(t->arg);
+    if (res)
+      return res;
+
+    if (!check)
+      continue;
+    if (t->or_bh == CL_OVERRUN_BH_IGNORE)
+      continue;
+    deadline = release + t->divisor * frame_ticks;
+    now = cl_clock_now(clk);
+    if ((int64_t)(now - deadline) <= 0) {
+      t->consecutive = 0;
+      continue;
+    }
+    ev = (cl_event_t){
+        .type = CL_EVENT_TASK_OVERRUN,
+        .task_index = i,
+        .cycle = exec->frame - 1,
+        .timestamp_ns = cl_clock_to_mono_ns(clk, now),
+        .value = cl_diff_ns(clk, now, deadline),
+    };
+    cl_event_emit(exec->inst, &ev);
+    if (t->or_bh == CL_OVERRUN_BH_STOP ||
+        (t->or_bh == CL_OVERRUN_BH_STOP_AFTER_K &&
+         ++t->consecutive >= t->or_stop_limit)) {
+      ev.type = CL_EVENT_TERMINATE;
+      cl_event_emit(exec->inst, &ev);
+      cl_inst_stop(exec->inst);
+      return 0;
+    }
+  }
+  return 0;
+}
+
+static long warmup_frame(void *exec_arg) {
+  cl_executor *exec = exec_arg;
+
+  exec->warming = true;
+  return run_frame(exec, false);
+}
+
+static long dispatch_frame(void *exec_arg) {
+  cl_executor *exec = exec_arg;
+
+  if (exec->warming) {
+    exec->warming = false;
+    restart_schedule(exec);
+  }
+  return run_frame(exec, true);
+}
+
+/* Realigning policies drop frames, which the task timeline cannot follow. */
+static bool realigns(cl_overrun_bh or_bh) {
+  return or_bh == CL_OVERRUN_BH_SKIP || or_bh == CL_OVERRUN_BH_CATCHUP_N;
+}
+
+struct cl_executor_s *cl_exec_create(const cl_attr_t *attrs) {
+  cl_executor *exec;
+
+  /* The warm-up frames run the task schedule, see cl_exec_run() */
+  if (realigns(attrs->or_bh) || attrs->warmup_fn)
+    return NULL;
+  exec = calloc(1, sizeof(*exec));
+  if (!exec)
+    return NULL;
+  memcpy(&exec->attrs, attrs, sizeof(exec->attrs));
+  return exec;
+}
+
+cl_status_t cl_exec_add(struct cl_executor_s *exec, cl_task task, void *arg,
+                        const cl_attr_t *attrs) {
+  cl_exec_task *tasks;
+
+  if (exec->inst)
+    return CL_ERR_BUSY;
+  if (!attrs->period_us)
+    return CL_ERR_INVAL;
+  if (realigns(attrs->or_bh) ||
+      (attrs->or_bh == CL_OVERRUN_BH_STOP_AFTER_K && !attrs->or_stop_limit))
+    return CL_ERR_INVAL;
+
+  tasks = realloc(exec->tasks, (exec->n_tasks + 1) * sizeof(*tasks));
+  if (!tasks)
+    return CL_ERR_NOMEM;
+  exec->tasks = tasks;
+  tasks[exec->n_tasks++] = (cl_exec_task){
+      .task = task,
+      .arg = arg,
+      .period_us = attrs->period_us,
+      .or_bh = attrs->or_bh,
+      .or_stop_limit = attrs->or_stop_limit,
+  };
+  return CL_OK;
+}
+
+cl_status_t cl_exec_run(struct cl_executor_s *exec) {
+  size_t minor = 0;
+
+  if (exec->inst)
+    return CL_ERR_BUSY;
+  if (!exec->n_tasks)
+    return CL_ERR_INVAL;
+
+  qsort(exec->tasks, exec->n_tasks, sizeof(*exec->tasks), cmp_period);
+  for (size_t i = 0; i < exec->n_tasks; i++)
+    minor = gcd(exec->tasks[i].period_us, minor);
+  for (size_t i = 0; i < exec->n_tasks; i++)
+    exec->tasks[i].divisor = exec->tasks[i].period_us / minor;
+  restart_schedule(exec);
+  exec->minor_us = minor;
+  exec->attrs.period_us = minor;
+  /* Warm up on the task schedule itself, without deadlines */
+  exec->attrs.warmup_fn = warmup_frame;
+
+  exec->inst = cl_inst_create(dispatch_frame, exec, &exec->attrs);
+  if (!exec->inst)
+    return CL_ERR_NOMEM;
+  if (cl_inst_run(exec->inst) != CL_OK) {
+    atomic_store_explicit(&exec->inst->is_joined, 1, memory_order_relaxed);
+    cl_inst_destroy(exec->inst);
+    exec->inst = NULL;
+    return CL_ERR_START;
+  }
+  return CL_OK;
+}
+
+cl_status_t cl_exec_stop(struct cl_executor_s *exec) {
+  if (!exec->inst)
+    return CL_ERR_INVAL;
+  return cl_inst_stop(exec->inst);
+}
+
+bool cl_exec_is_stopped(struct cl_executor_s *exec) {
+  return exec->inst && cl_inst_is_stopped(exec->inst);
+}
+
+cl_status_t cl_exec_join(struct cl_executor_s *exec, long *ret) {
+  if (!exec->inst)
+    return CL_ERR_JOIN;
+  return cl_inst_join(exec->inst, ret);
+}
+
+struct cl_instanse_s *cl_exec_get_inst(struct cl_executor_s *exec) {
+  return exec->inst;
+}
+
+cl_status_t cl_exec_destroy(struct cl_executor_s *exec) {
+  if (exec->inst && cl_inst_destroy(exec->inst) != CL_OK)
+    return CL_ERR_BUSY;
+  free(exec->tasks);
+  free(exec);
+  return CL_OK;
+}
@@ -0,0 +1,164 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct cl_group_s {
+  cl_gate gate;
+  struct cl_instanse_s **insts;
+  size_t n_insts;
+  bool running;
+} cl_group;
+
+/* A thread cancelled while parked owns the lock again and aborts the start. */
+static void gate_wait_cancelled(void *gate_arg) {
+  cl_gate *gate = gate_arg;
+
+  gate->aborted = true;
+  pthread_cond_broadcast(&gate->cond);
+  pthread_mutex_unlock(&gate->lock);
+}
+
+bool cl_gate_wait(cl_gate *gate, uint64_t *release_ns) {
+  bool released;
+
+  pthread_mutex_lock(&gate->lock);
+  gate->ready++;
+  pthread_cond_broadcast(&gate->cond);
+  pthread_cleanup_push(gate_wait_cancelled, gate);
+  while (!gate->released && !gate->aborted)
+    pthread_cond_wait(&gate->cond, &gate->lock);
+  pthread_cleanup_pop(0);
+  released = !gate->aborted;
+  *release_ns = gate->release_ns;
+  pthread_mutex_unlock(&gate->lock);
+  return released;
+}
+
+void cl_gate_leave(cl_gate *gate) {
+  pthread_mutex_lock(&gate->lock);
+  gate->ready++;
+  gate->aborted = true;
+  pthread_cond_broadcast(&gate->cond);
+  pthread_mutex_unlock(&gate->lock);
+}
+
+static void gate_abort(cl_gate *gate) {
+  pthread_mutex_lock(&gate->lock);
+  gate->aborted = true;
+  pthread_cond_broadcast(&gate->cond);
+  pthread_mutex_unlock(&gate->lock);
+}
+
+/* False if a thread left before the release; the others are aborted. */
+static bool gate_release(cl_gate *gate, uint64_t delay_ns) {
+  bool released;
+
+  pthread_mutex_lock(&gate->lock);
+  while (gate->ready < gate->expected && !gate->aborted)
+    pthread_cond_wait(&gate->cond, &gate->lock);
+  released = !gate->aborted;
+  if (released) {
+    gate->release_ns = cl_mono_ns() + delay_ns;
+    gate->released = true;
+  }
+  pthread_cond_broadcast(&gate->cond);
+  pthread_mutex_unlock(&gate->lock);
+  return released;
+}
+
+struct cl_group_s *cl_group_create(void) {
+  cl_group *grp = calloc(1, sizeof(*grp));
+  if (!grp)
+    return NULL;
+  pthread_mutex_init(&grp->gate.lock, NULL);
+  pthread_cond_init(&grp->gate.cond, NULL);
+  return grp;
+}
+
+struct cl_instanse_s *cl_group_add(struct cl_group_s *grp, cl_task task,
+                                   void *arg, const cl_attr_t *attrs,
+                                   size_t phase_us) {
+  struct cl_instanse_s **insts;
+  struct cl_instanse_s *inst;
+
+  if (grp->running)
+    return NULL;
+  insts = realloc(grp->insts, (grp->n_insts + 1) * sizeof(*insts));
+  if (!insts)
+    return NULL;
+  grp->insts = insts;
+
+  inst = cl_inst_create(task, arg, attrs);
+  if (!inst)
+    return NULL;
+  inst->gate = &grp->gate;
+  inst->phase_ns = (uint64_t)phase_us * 1000;
+  insts[grp->n_insts++] = inst;
+  return inst;
+}
+
+cl_status_t cl_group_run(struct cl_group_s *grp, size_t start_delay_us) {
+  if (grp->running)
+    return CL_ERR_BUSY;
+  if (!grp->n_insts)
+    return CL_ERR_INVAL;
+
+  grp->gate.expected = grp->n_insts;
+  for (size_t i = 0; i < grp->n_insts; i++) {
+    if (cl_inst_run(grp->insts[i]) == CL_OK)
+      continue;
+    gate_abort(&grp->gate);
+    for (size_t j = 0; j < i; j++)
+      cl_inst_join(grp->insts[j], NULL);
+    return CL_ERR_START;
+  }
+  if (!gate_release(&grp->gate, (uint64_t)start_delay_us * 1000)) {
+    for (size_t i = 0; i < grp->n_insts; i++)
+      cl_inst_join(grp->insts[i], NULL);
+    return CL_ERR_START;
+  }
+  grp->running = true;
+  return CL_OK;
+}
+
+cl_status_t cl_group_stop(struct cl_group_s *grp) {
+  for (size_t i = 0; i < grp->n_insts; i++)
+    cl_inst_stop(grp->insts[i]);
+  return CL_OK;
+}
+
+bool cl_group_is_stopped(struct cl_group_s *grp) {
+  for (size_t i = 0; i < grp->n_insts; i++)
+    if (!cl_inst_is_stopped(grp->insts[i]))
+      return false;
+  return true;
+}
+
+cl_status_t cl_group_join(struct cl_group_s *grp, long *rets) {
+  cl_status_t status = CL_OK;
+  for (size_t i = 0; i < grp->n_insts; i++)
+    if (cl_inst_join(grp->insts[i], rets ? &rets[i] : NULL) != CL_OK)
+      status = CL_ERR_JOIN;
+  return status;
+}
+
+size_t cl_group_size(struct cl_group_s *grp) { return grp->n_insts; }
+
+cl_status_t cl_group_destroy(struct cl_group_s *grp) {
+  for (size_t i = 0; grp->running && i < grp->n_insts; i++)
+    if (!atomic_load_explicit(&grp->insts[i]->is_joined, memory_order_relaxed))
+      return CL_ERR_BUSY;
+  for (size_t i = 0; i < grp->n_insts; i++) {
+    /* Instances of a group that never started have no thread to join. */
+    atomic_store_explicit(&grp->insts[i]->is_joined, 1, memory_order_relaxed);
+    cl_inst_destroy(grp->insts[i]);
+  }
+  pthread_cond_destroy(&grp->gate.cond);
+  pthread_mutex_destroy(&grp->gate.lock);
+  free(grp->insts);
+  free(grp);
+  return CL_OK;
+}
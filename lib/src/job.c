@@ -0,0 +1,133 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <stdatomic.h>
+#include <ucontext.h>
+
+/* Default of cl_attr_t.job_margin_us. */
+#define CL_JOB_DEF_MARGIN_US 20
+
+enum {
+  CL_JOB_IDLE,
+  /* A submitter owns fn and arg until it publishes them. */
+  CL_JOB_CLAIMED,
+  CL_JOB_PENDING,
+  CL_JOB_RUNNING,
+};
+
+typedef struct cl_job_s {
+  /* Job and RT loop contexts, swapped in the slack. RT thread only. */
+  ucontext_t ctx;
+  ucontext_t loop_ctx;
+  unsigned char *stack;
+  uint64_t margin_ticks;
+  /* The job has to be back in the loop by then. */
+  uint64_t end_tick;
+  /* Set while the RT thread runs on the job stack. */
+  bool active;
+  cl_job_fn fn;
+  void *arg;
+  atomic_int state;
+} cl_job;
+
+bool cl_job_init(cl_instanse *inst) {
+  size_t margin_us = inst->attrs.job_margin_us;
+  size_t size = inst->attrs.job_stack_size;
+  cl_job *job;
+
+  if (!size)
+    return true;
+  if (size < (size_t)PTHREAD_STACK_MIN)
+    return false;
+  job = cl_mem_alloc(sizeof(*job), inst->numa_node);
+  if (!job)
+    return false;
+  /* Zero-filled, so the stack is faulted in before the first slice */
+  job->stack = cl_mem_alloc(size, inst->numa_node);
+  if (!job->stack) {
+    cl_mem_free(job, sizeof(*job), inst->numa_node);
+    return false;
+  }
+  if (!margin_us)
+    margin_us = CL_JOB_DEF_MARGIN_US;
+  job->margin_ticks = cl_ns_to_ticks(&inst->clock, margin_us * 1000);
+  atomic_init(&job->state, CL_JOB_IDLE);
+  inst->job = job;
+  return true;
+}
+
+void cl_job_free(cl_instanse *inst) {
+  cl_job *job = inst->job;
+
+  if (!job)
+    return;
+  cl_mem_free(job->stack, inst->attrs.job_stack_size, inst->numa_node);
+  cl_mem_free(job, sizeof(*job), inst->numa_node);
+  inst->job = NULL;
+}
+
+/* First frame on the job stack; returning resumes loop_ctx via uc_link. */
+static void job_entry(void) {
+  cl_job *job = cl_self->job;
+
+  job->fn(job->arg);
+  atomic_store_explicit(&job->state, CL_JOB_IDLE, memory_order_release);
+}
+
+void cl_job_run(cl_instanse *inst, uint64_t next_tick) {
+  cl_job *job = inst->job;
+  int state = atomic_load_explicit(&job->state, memory_order_acquire);
+
+  if (state != CL_JOB_PENDING && state != CL_JOB_RUNNING)
+    return;
+  job->end_tick = next_tick - job->margin_ticks;
+  if ((int64_t)(cl_clock_now(&inst->clock) - job->end_tick) >= 0)
+    return;
+  if (state == CL_JOB_PENDING) {
+    getcontext(&job->ctx);
+    job->ctx.uc_stack.ss_sp = job->stack;
+    job->ctx.uc_stack.ss_size = inst->attrs.job_stack_size;
+    job->ctx.uc_link = &job->loop_ctx;
+    makecontext(&job->ctx, job_entry, 0);
+    atomic_store_explicit(&job->state, CL_JOB_RUNNING, memory_order_relaxed);
+  }
+  job->active = true;
+  swapcontext(&job->loop_ctx, &job->ctx);
+  job->active = false;
+}
+
+void cl_job_yield(void) {
+  cl_instanse *inst = cl_self;
+  cl_job *job = inst ? inst->job : NULL;
+
+  if (!job || !job->active)
+    return;
+  if ((int64_t)(cl_clock_now(&inst->clock) - job->end_tick) < 0 &&
+      !atomic_load_explicit(&inst->stop_flag, memory_order_relaxed))
+    return;
+  swapcontext(&job->ctx, &job->loop_ctx);
+}
+
+cl_status_t cl_inst_submit_job(struct cl_instanse_s *inst, cl_job_fn fn,
+                               void *arg) {
+  cl_job *job = inst->job;
+  int idle = CL_JOB_IDLE;
+
+  if (!job || !fn)
+    return CL_ERR_INVAL;
+  if (!atomic_compare_exchange_strong_explicit(&job->state, &idle,
+                                               CL_JOB_CLAIMED,
+                                               memory_order_acquire,
+                                               memory_order_relaxed))
+    return CL_ERR_BUSY;
+  job->fn = fn;
+  job->arg = arg;
+  atomic_store_explicit(&job->state, CL_JOB_PENDING, memory_order_release);
+  return CL_OK;
+}
+
+bool cl_inst_job_busy(struct cl_instanse_s *inst) {
+  return inst->job && atomic_load_explicit(&inst->job->state,
+                                           memory_order_acquire) != CL_JOB_IDLE;
+}
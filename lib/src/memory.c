@@ -0,0 +1,86 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define CL_MAX_NUMA_NODES 1024
+
+static size_t round_up_to(size_t size, size_t align) {
+  return (size + align - 1) & ~(align - 1);
+}
+
+int cl_numa_node_of(const cpu_set_t *mask, size_t mask_size) {
+  char path[64];
+  struct dirent *ent;
+  DIR *dir;
+  int cpu = -1;
+  int node = -1;
+
+  if (!mask)
+    return -1;
+  for (size_t i = 0; i < mask_size * 8; i++) {
+    if (CPU_ISSET_S(i, mask_size, mask)) {
+      cpu = (int)i;
+      break;
+    }
+  }
+  if (cpu < 0)
+    return -1;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  dir = opendir(path);
+  if (!dir)
+    return -1;
+  while ((ent = readdir(dir)))
+    if (sscanf(ent->d_name, "node%d", &node) == 1)
+      break;
+  closedir(dir);
+  return node;
+}
+
+void *cl_mem_alloc(size_t size, int node) {
+  unsigned long nodemask[CL_MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+  size_t len;
+  void *mem;
+
+  if (node < 0 || node >= CL_MAX_NUMA_NODES) {
+    len = round_up_to(size, CL_CACHE_LINE);
+    mem = aligned_alloc(CL_CACHE_LINE, len);
+    if (mem)
+      memset(mem, 0, len);
+    return mem;
+  }
+
+  len = round_up_to(size, (size_t)sysconf(_SC_PAGESIZE));
+  mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  if (mem == MAP_FAILED)
+    return NULL;
+
+  memset(nodemask, 0, sizeof(nodemask));
+  nodemask[node / (8 * sizeof(unsigned long))] |=
+      1UL << (node % (8 * sizeof(unsigned long)));
+  /* Best effort: without the binding the memory is just local to the caller */
+  syscall(SYS_mbind, mem, len, MPOL_PREFERRED, nodemask, CL_MAX_NUMA_NODES, 0);
+  /* Fault the pages in now so they are placed on the node right away */
+  memset(mem, 0, len);
+  return mem;
+}
+
+void cl_mem_free(void *ptr, size_t size, int node) {
+  if (!ptr)
+    return;
+  if (node < 0 || node >= CL_MAX_NUMA_NODES) {
+    free(ptr);
+    return;
+  }
+  munmap(ptr, round_up_to(size, (size_t)sysconf(_SC_PAGESIZE)));
+}
@@ -0,0 +1,161 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <linux/perf_event.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define CL_PMC_CACHE(cache)                                                    \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                              \
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} pmc_defs[CL_PMC_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CL_PMC_CACHE(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, CL_PMC_CACHE(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int perf_open(struct perf_event_attr *attr, int group_fd) {
+  return (int)syscall(SYS_perf_event_open, attr, 0, -1, group_fd,
+                      PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Counters of the calling thread, user space only, in one group so that
+ * they are scheduled on the PMU together. Events the hardware or the
+ * perf_event_paranoid level do not allow are left out.
+ */
+void cl_pmc_open(cl_instanse *inst) {
+  cl_pmc *pmc = &inst->pmc;
+  long page_size = sysconf(_SC_PAGESIZE);
+  unsigned seq;
+  int leader = -1;
+
+  for (unsigned i = 0; i < CL_PMC_COUNT; i++) {
+    struct perf_event_attr attr = {
+        .type = pmc_defs[i].type,
+        .size = sizeof(attr),
+        .config = pmc_defs[i].config,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+        .pinned = leader < 0,
+    };
+    void *page;
+    int fd;
+
+    pmc->fd[i] = -1;
+    if (!(inst->attrs.pmc_events & (1U << i)))
+      continue;
+    fd = perf_open(&attr, leader);
+    if (fd < 0)
+      continue;
+    page = mmap(NULL, (size_t)page_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+      close(fd);
+      continue;
+    }
+    if (leader < 0)
+      leader = fd;
+    pmc->fd[i] = fd;
+    pmc->page[i] = page;
+    pmc->active |= 1U << i;
+  }
+
+  seq = atomic_load_explicit(&inst->stats_seq, memory_order_relaxed);
+  atomic_store_explicit(&inst->stats_seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  inst->stats.pmc_events = pmc->active;
+  for (unsigned i = 0; i < CL_PMC_COUNT; i++)
+    cl_stat_acc_reset(&inst->stats.pmc[i]);
+  atomic_store_explicit(&inst->stats_seq, seq + 2, memory_order_release);
+}
+
+void cl_pmc_close(cl_instanse *inst) {
+  cl_pmc *pmc = &inst->pmc;
+  long page_size = sysconf(_SC_PAGESIZE);
+
+  /* Members first, the group leader closes last */
+  for (unsigned i = CL_PMC_COUNT; i-- > 0;) {
+    if (!(pmc->active & (1U << i)))
+      continue;
+    munmap(pmc->page[i], (size_t)page_size);
+    close(pmc->fd[i]);
+  }
+  pmc->active = 0;
+}
+
+/*
+ * Self-monitoring read of the mmap page protocol, see perf_event_open(2):
+ * rdpmc while the counter is on the PMU and user access is enabled, read()
+ * otherwise.
+ */
+static uint64_t pmc_read(const cl_pmc *pmc, unsigned i) {
+  uint64_t count;
+#if defined(__x86_64__)
+  const volatile struct perf_event_mmap_page *pc = pmc->page[i];
+  uint32_t seq, idx;
+
+  do {
+    seq = pc->lock;
+    atomic_signal_fence(memory_order_seq_cst);
+    idx = pc->index;
+    if (!pc->cap_user_rdpmc || !idx)
+      break;
+    count = (uint64_t)pc->offset;
+    uint64_t raw = __builtin_ia32_rdpmc((int)idx - 1);
+    unsigned shift = 64 - pc->pmc_width;
+    count += (uint64_t)((int64_t)(raw << shift) >> shift);
+    atomic_signal_fence(memory_order_seq_cst);
+    if (pc->lock == seq)
+      return count;
+  } while (true);
+#endif
+  if (read(pmc->fd[i], &count, sizeof(count)) != sizeof(count))
+    return 0;
+  return count;
+}
+
+void cl_pmc_begin(cl_instanse *inst) {
+  cl_pmc *pmc = &inst->pmc;
+  for (unsigned i = 0; i < CL_PMC_COUNT; i++)
+    if (pmc->active & (1U << i))
+      pmc->start[i] = pmc_read(pmc, i);
+}
+
+void cl_pmc_end(cl_instanse *inst) {
+  cl_pmc *pmc = &inst->pmc;
+  for (unsigned i = 0; i < CL_PMC_COUNT; i++)
+    if (pmc->active & (1U << i))
+      pmc->delta[i] = pmc_read(pmc, i) - pmc->start[i];
+}
+
+void cl_pmc_record(cl_instanse *inst) {
+  cl_pmc *pmc = &inst->pmc;
+  for (unsigned i = 0; i < CL_PMC_COUNT; i++)
+    if (pmc->active & (1U << i))
+      cl_stat_acc_add(&inst->stats.pmc[i], (long long)pmc->delta[i]);
+}
+
+void cl_pmc_stats(cl_stats_t *stats, const cl_stats_acc *snap) {
+  stats->pmc_events = snap->pmc_events;
+  for (unsigned i = 0; i < CL_PMC_COUNT; i++) {
+    const cl_stat_acc *acc = &snap->pmc[i];
+    if (!(snap->pmc_events & (1U << i)) || !snap->cycles) {
+      stats->pmc[i] = (cl_pmc_stat_t){0};
+      continue;
+    }
+    stats->pmc[i] = (cl_pmc_stat_t){
+        .min = acc->min,
+        .max = acc->max,
+        .mean = acc->sum / (long long)snap->cycles,
+    };
+  }
+}
@@ -0,0 +1,224 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CL_SHM_DEF_INTERVAL_US 100000
+#define CL_SHM_PATH_LEN 256
+#define CL_SHM_READ_RETRIES 1000
+
+/* The seqlock word of the public layout, accessed as an atomic. */
+CL_STATIC_ASSERT(sizeof(atomic_uint) == sizeof(uint32_t),
+                 "cl_shm_status_t.seq must map to atomic_uint");
+
+static inline atomic_uint *shm_seq(const cl_shm_status_t *seg) {
+  return (atomic_uint *)&seg->seq;
+}
+
+static bool shm_path(const char *name, char *buf, size_t size) {
+  if (!*name || strchr(name, '/'))
+    return false;
+  return (size_t)snprintf(buf, size, "/corelock.%s", name) < size;
+}
+
+static int first_cpu(const cl_attr_t *attrs) {
+  if (!attrs->cpu_mask)
+    return -1;
+  for (size_t cpu = 0; cpu < attrs->cpu_mask_size * 8; cpu++)
+    if (CPU_ISSET_S(cpu, attrs->cpu_mask_size, attrs->cpu_mask))
+      return (int)cpu;
+  return -1;
+}
+
+/* A segment whose owner process is gone was left behind by a crash. */
+static bool shm_stale(const char *path) {
+  cl_shm_status_t *map;
+  struct stat sb;
+  bool stale;
+  int fd;
+
+  fd = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0)
+    return false;
+  if (fstat(fd, &sb) || (size_t)sb.st_size < sizeof(*map)) {
+    close(fd);
+    return false;
+  }
+  map = mmap(NULL, sizeof(*map), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  stale = !memcmp(map->magic, CL_SHM_MAGIC, sizeof(CL_SHM_MAGIC)) &&
+          map->pid > 0 && kill(map->pid, 0) && errno == ESRCH;
+  munmap(map, sizeof(*map));
+  return stale;
+}
+
+bool cl_shm_init(cl_instanse *inst) {
+  char path[CL_SHM_PATH_LEN];
+  cl_shm_status_t *seg;
+  int fd;
+
+  if (!inst->attrs.shm_name)
+    return true;
+  if (!shm_path(inst->attrs.shm_name, path, sizeof(path)))
+    return false;
+  fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+  /* The segment of a dead owner is reclaimed, a live one keeps its name */
+  if (fd < 0 && errno == EEXIST && shm_stale(path)) {
+    shm_unlink(path);
+    fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+  }
+  if (fd < 0) {
+    if (errno == EEXIST)
+      fprintf(stderr, "corelock: shm segment /dev/shm%s is in use\n", path);
+    return false;
+  }
+  if (ftruncate(fd, sizeof(*seg))) {
+    close(fd);
+    shm_unlink(path);
+    return false;
+  }
+  seg = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (seg == MAP_FAILED) {
+    shm_unlink(path);
+    return false;
+  }
+
+  /* A reader of a stale segment sees version 0 until the header is filled */
+  memset(seg, 0, sizeof(*seg));
+  memcpy(seg->magic, CL_SHM_MAGIC, sizeof(CL_SHM_MAGIC));
+  seg->size = sizeof(*seg);
+  seg->pid = getpid();
+  seg->cpu = first_cpu(&inst->attrs);
+  atomic_store_explicit(shm_seq(seg), 0, memory_order_relaxed);
+  inst->shm = seg;
+  cl_shm_publish(inst, CL_SHM_CREATED);
+  atomic_thread_fence(memory_order_release);
+  seg->version = CL_SHM_VERSION;
+
+  if (!inst->attrs.shm_interval_us)
+    inst->attrs.shm_interval_us = CL_SHM_DEF_INTERVAL_US;
+  cl_shm_update(inst);
+  return true;
+}
+
+void cl_shm_update(cl_instanse *inst) {
+  size_t interval_us = inst->attrs.shm_interval_us;
+  size_t period_us = inst->attrs.period_us;
+
+  inst->shm_interval_cycles = period_us && interval_us > period_us
+                                  ? (unsigned)(interval_us / period_us)
+                                  : 1;
+}
+
+void cl_shm_free(cl_instanse *inst) {
+  char path[CL_SHM_PATH_LEN];
+
+  if (!inst->shm)
+    return;
+  munmap(inst->shm, sizeof(*inst->shm));
+  inst->shm = NULL;
+  if (shm_path(inst->attrs.shm_name, path, sizeof(path)))
+    shm_unlink(path);
+}
+
+static void put_stat(int64_t *min, int64_t *mean, int64_t *max,
+                     const cl_stat_acc *acc, unsigned long long cycles) {
+  cl_stat_t stat;
+  cl_stat_from_acc(&stat, acc, cycles);
+  *min = stat.min_ns;
+  *mean = stat.mean_ns;
+  *max = stat.max_ns;
+}
+
+/*
+ * Called by the RT thread only, so the statistics are read without their
+ * own seqlock.
+ */
+void cl_shm_publish(cl_instanse *inst, cl_shm_state state) {
+  cl_shm_status_t *seg = inst->shm;
+  const cl_stats_acc *st = &inst->stats;
+  unsigned seq = atomic_load_explicit(shm_seq(seg), memory_order_relaxed);
+
+  atomic_store_explicit(shm_seq(seg), seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  seg->state = state;
+  seg->period_us = inst->attrs.period_us;
+  seg->priority = inst->attrs.priority;
+  seg->sched_policy = inst->attrs.sched_policy;
+  seg->or_bh = inst->attrs.or_bh;
+  seg->wait_mode = inst->attrs.wait_mode;
+  seg->update_ns = cl_mono_ns();
+  seg->cycle = inst->cycle;
+  if (inst->attrs.collect_stats) {
+    seg->overruns = st->overruns;
+    seg->skipped_periods = st->skipped_periods;
+    put_stat(&seg->latency_min_ns, &seg->latency_mean_ns,
+             &seg->latency_max_ns, &st->latency, st->cycles);
+    put_stat(&seg->exec_min_ns, &seg->exec_mean_ns, &seg->exec_max_ns,
+             &st->exec, st->cycles);
+    put_stat(&seg->slack_min_ns, &seg->slack_mean_ns, &seg->slack_max_ns,
+             &st->slack, st->cycles);
+  }
+
+  atomic_store_explicit(shm_seq(seg), seq + 2, memory_order_release);
+}
+
+cl_status_t cl_shm_attach(const char *name, const cl_shm_status_t **seg) {
+  char path[CL_SHM_PATH_LEN];
+  cl_shm_status_t *map;
+  struct stat sb;
+  int fd;
+
+  if (!shm_path(name, path, sizeof(path)))
+    return CL_ERR_INVAL;
+  fd = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0)
+    return CL_ERR_IO;
+  if (fstat(fd, &sb) || (size_t)sb.st_size < sizeof(*map)) {
+    close(fd);
+    return CL_ERR_INVAL;
+  }
+  map = mmap(NULL, sizeof(*map), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return CL_ERR_IO;
+  if (memcmp(map->magic, CL_SHM_MAGIC, sizeof(CL_SHM_MAGIC)) ||
+      map->version != CL_SHM_VERSION || map->size != sizeof(*map)) {
+    munmap(map, sizeof(*map));
+    return CL_ERR_INVAL;
+  }
+  *seg = map;
+  return CL_OK;
+}
+
+cl_status_t cl_shm_read(const cl_shm_status_t *seg, cl_shm_status_t *out) {
+  for (int i = 0; i < CL_SHM_READ_RETRIES; i++) {
+    unsigned seq = atomic_load_explicit(shm_seq(seg), memory_order_acquire);
+    if (seq & 1) {
+      cl_cpu_relax();
+      continue;
+    }
+    memcpy(out, seg, sizeof(*out));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(shm_seq(seg), memory_order_relaxed) == seq)
+      return CL_OK;
+  }
+  return CL_ERR_BUSY;
+}
+
+void cl_shm_detach(const cl_shm_status_t *seg) {
+  munmap((void *)seg, sizeof(*seg));
+}
@@ -0,0 +1,164 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Longest hyperperiod considered when placing automatic phases. */
+#define CL_SUBTASK_MAX_HYPER 4096
+
+static size_t gcd(size_t a, size_t b) {
+  while (b) {
+    size_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+cl_status_t cl_inst_add_subtask(struct cl_instanse_s *inst, cl_task fn,
+                                void *arg, unsigned divisor, unsigned phase) {
+  cl_subtask *subtasks;
+  cl_subtask_acc *stats;
+  size_t n = inst->n_subtasks + 1;
+
+  if (inst->started)
+    return CL_ERR_BUSY;
+  if (!fn || !divisor || inst->attrs.loop ||
+      (phase != CL_SUBTASK_PHASE_AUTO && phase >= divisor))
+    return CL_ERR_INVAL;
+
+  subtasks = realloc(inst->subtasks, n * sizeof(*subtasks));
+  if (!subtasks)
+    return CL_ERR_NOMEM;
+  inst->subtasks = subtasks;
+  stats = realloc(inst->subtask_stats, n * sizeof(*stats));
+  if (!stats)
+    return CL_ERR_NOMEM;
+  inst->subtask_stats = stats;
+
+  subtasks[n - 1] = (cl_subtask){
+      .fn = fn,
+      .arg = arg,
+      .divisor = divisor,
+      .phase = phase,
+      .pending_exec = -1,
+  };
+  stats[n - 1].runs = 0;
+  cl_stat_acc_reset(&stats[n - 1].exec);
+  inst->n_subtasks = n;
+  return CL_OK;
+}
+
+/*
+ * Greedy placement over the hyperperiod of the chain: every automatic
+ * subtask, in registration order, takes the phase whose busiest cycle is the
+ * least loaded so far.
+ */
+static void place_auto(cl_instanse *inst) {
+  size_t hyper = 1;
+  unsigned *load;
+
+  for (size_t i = 0; i < inst->n_subtasks && hyper < CL_SUBTASK_MAX_HYPER; i++)
+    hyper = hyper / gcd(hyper, inst->subtasks[i].divisor) *
+            inst->subtasks[i].divisor;
+  if (hyper > CL_SUBTASK_MAX_HYPER)
+    hyper = CL_SUBTASK_MAX_HYPER;
+
+  load = calloc(hyper, sizeof(*load));
+  for (size_t i = 0; i < inst->n_subtasks; i++) {
+    cl_subtask *st = &inst->subtasks[i];
+    unsigned best = 0, best_peak = UINT_MAX;
+
+    if (st->phase == CL_SUBTASK_PHASE_AUTO) {
+      for (unsigned p = 0; load && p < st->divisor && p < hyper; p++) {
+        unsigned peak = 0;
+        for (size_t c = p; c < hyper; c += st->divisor)
+          if (load[c] > peak)
+            peak = load[c];
+        if (peak < best_peak) {
+          best_peak = peak;
+          best = p;
+        }
+      }
+      st->phase = best;
+    }
+    for (size_t c = st->phase; load && c < hyper; c += st->divisor)
+      load[c]++;
+  }
+  free(load);
+}
+
+void cl_subtasks_prepare(cl_instanse *inst) {
+  if (!inst->n_subtasks)
+    return;
+  place_auto(inst);
+  for (size_t i = 0; i < inst->n_subtasks; i++)
+    inst->subtasks[i].countdown = inst->subtasks[i].phase + 1;
+}
+
+void cl_subtasks_free(cl_instanse *inst) {
+  free(inst->subtasks);
+  free(inst->subtask_stats);
+  inst->subtasks = NULL;
+  inst->subtask_stats = NULL;
+  inst->n_subtasks = 0;
+}
+
+long cl_subtasks_run(cl_instanse *inst, bool timed) {
+  const cl_clock *clk = &inst->clock;
+  uint64_t start = 0;
+  long res;
+
+  for (size_t i = 0; i < inst->n_subtasks; i++) {
+    cl_subtask *st = &inst->subtasks[i];
+    if (--st->countdown)
+      continue;
+    st->countdown = st->divisor;
+    if (timed)
+      start = cl_clock_now(clk);
+    res = st->fn(st->arg);
+    if (timed)
+      st->pending_exec = cl_diff_ns(clk, cl_clock_now(clk), start);
+    if (res)
+      return res;
+  }
+  return 0;
+}
+
+void cl_subtasks_record(cl_instanse *inst) {
+  for (size_t i = 0; i < inst->n_subtasks; i++) {
+    cl_subtask *st = &inst->subtasks[i];
+    if (st->pending_exec < 0)
+      continue;
+    inst->subtask_stats[i].runs++;
+    cl_stat_acc_add(&inst->subtask_stats[i].exec, st->pending_exec);
+    st->pending_exec = -1;
+  }
+}
+
+cl_status_t cl_inst_get_subtask_stats(struct cl_instanse_s *inst, size_t index,
+                                      cl_subtask_stats_t *stats) {
+  cl_subtask_acc snap;
+  unsigned seq;
+
+  if (!inst->attrs.collect_stats || index >= inst->n_subtasks)
+    return CL_ERR_INVAL;
+
+  for (;;) {
+    seq = atomic_load_explicit(&inst->stats_seq, memory_order_acquire);
+    if (seq & 1)
+      continue;
+    memcpy(&snap, &inst->subtask_stats[index], sizeof(snap));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&inst->stats_seq, memory_order_relaxed) == seq)
+      break;
+  }
+
+  stats->phase = inst->subtasks[index].phase;
+  stats->runs = snap.runs;
+  cl_stat_from_acc(&stats->exec_time, &snap.exec, snap.runs);
+  return CL_OK;
+}
@@ -0,0 +1,91 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Dynamic POSIX clock of an open PHC character device, see clock_getres(2). */
+#define CL_FD_TO_CLOCKID(fd) ((~(clockid_t)(fd) << 3) | 3)
+
+#define CL_SYNC_SAMPLES 3
+#define CL_SYNC_DEF_INTERVAL 100
+#define CL_SYNC_DEF_SLEW_NS 1000
+
+static uint64_t ts_to_ns(const struct timespec *ts) {
+  return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+bool cl_sync_open(cl_instanse *inst) {
+  struct timespec ts;
+
+  if (inst->attrs.sync_source == CL_SYNC_NONE)
+    return true;
+  if (inst->attrs.trigger != CL_TRIGGER_PERIODIC)
+    return false;
+
+  switch (inst->attrs.sync_source) {
+  case CL_SYNC_NONE:
+    break;
+  case CL_SYNC_TAI:
+    inst->sync_clock = CLOCK_TAI;
+    break;
+  case CL_SYNC_PHC:
+    if (!inst->attrs.sync_phc_path)
+      return false;
+    inst->sync_fd = open(inst->attrs.sync_phc_path, O_RDONLY | O_CLOEXEC);
+    if (inst->sync_fd < 0)
+      return false;
+    inst->sync_clock = CL_FD_TO_CLOCKID(inst->sync_fd);
+    break;
+  }
+  if (clock_gettime(inst->sync_clock, &ts)) {
+    cl_sync_close(inst);
+    return false;
+  }
+
+  if (!inst->attrs.sync_interval_cycles)
+    inst->attrs.sync_interval_cycles = CL_SYNC_DEF_INTERVAL;
+  if (!inst->attrs.sync_max_slew_ns)
+    inst->attrs.sync_max_slew_ns = CL_SYNC_DEF_SLEW_NS;
+  return true;
+}
+
+void cl_sync_close(cl_instanse *inst) {
+  if (inst->sync_fd >= 0)
+    close(inst->sync_fd);
+  inst->sync_fd = -1;
+}
+
+/*
+ * The reference read is bracketed by two local reads, like the counter
+ * calibration, and the tightest bracket maps the local release to the
+ * reference time line. PHC reads are syscalls of a few microseconds, so a
+ * handful of samples is enough.
+ */
+long long cl_sync_offset(cl_instanse *inst, uint64_t release) {
+  const cl_clock *clk = &inst->clock;
+  uint64_t best = UINT64_MAX, local = 0, ref = 0, ref_release;
+  long long period_ns = (long long)inst->attrs.period_us * 1000;
+  long long phase;
+  struct timespec ts;
+
+  for (int i = 0; i < CL_SYNC_SAMPLES; i++) {
+    uint64_t t0 = cl_clock_now(clk);
+    clock_gettime(inst->sync_clock, &ts);
+    uint64_t t1 = cl_clock_now(clk);
+    if (t1 - t0 < best) {
+      best = t1 - t0;
+      local = t0 + (t1 - t0) / 2;
+      ref = ts_to_ns(&ts);
+    }
+  }
+
+  ref_release = ref - (uint64_t)cl_diff_ns(clk, local, release);
+  phase = (long long)(ref_release % (uint64_t)period_ns);
+  if (phase >= period_ns / 2)
+    phase -= period_ns;
+  return phase;
+}
@@ -0,0 +1,122 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool cl_trace_init(cl_instanse *inst) {
+  size_t size = inst->attrs.trace_cycles;
+  if (!size)
+    return true;
+  size = cl_round_up_pow2(size);
+  inst->trace_buf = cl_mem_alloc(size * sizeof(*inst->trace_buf),
+                                 inst->numa_node);
+  if (!inst->trace_buf)
+    return false;
+  inst->trace_mask = size - 1;
+  return true;
+}
+
+void cl_trace_free(cl_instanse *inst) {
+  cl_mem_free(inst->trace_buf, (inst->trace_mask + 1) * sizeof(*inst->trace_buf),
+              inst->numa_node);
+  inst->trace_buf = NULL;
+}
+
+/*
+ * Copies the ring without stopping the RT thread. A record being written
+ * during the copy overwrites the slot of the oldest one, so records that may
+ * have been overwritten are dropped unless the loop has already finished.
+ */
+static size_t trace_snapshot(cl_instanse *inst, cl_trace_slot *snap,
+                             size_t *first) {
+  size_t size = inst->trace_mask + 1;
+  bool finished = atomic_load_explicit(&inst->is_finished, memory_order_acquire);
+  size_t h1 = atomic_load_explicit(&inst->trace_head, memory_order_acquire);
+  size_t h2;
+
+  memcpy(snap, inst->trace_buf, size * sizeof(*snap));
+  atomic_thread_fence(memory_order_acquire);
+  h2 = atomic_load_explicit(&inst->trace_head, memory_order_relaxed);
+
+  *first = h1 > size ? h1 - size : 0;
+  if (!finished && h2 + 1 > size && h2 + 1 - size > *first)
+    *first = h2 + 1 - size;
+  return *first < h1 ? h1 - *first : 0;
+}
+
+static cl_status_t trace_write(cl_instanse *inst, const char *path) {
+  const cl_clock *clk = &inst->clock;
+  size_t period_us =
+      atomic_load_explicit(&inst->trace_period_us, memory_order_relaxed);
+  cl_trace_header_t hdr = {
+      .magic = CL_TRACE_MAGIC,
+      .version = CL_TRACE_VERSION,
+      .rec_size = sizeof(cl_trace_rec_t),
+      .period_ns = (uint64_t)period_us * 1000,
+      .start_ns = cl_clock_to_mono_ns(clk, inst->start_tick),
+  };
+  cl_status_t status = CL_OK;
+  cl_trace_slot *snap;
+  size_t first;
+  FILE *out;
+
+  snap = malloc((inst->trace_mask + 1) * sizeof(*snap));
+  if (!snap)
+    return CL_ERR_NOMEM;
+  hdr.count = trace_snapshot(inst, snap, &first);
+
+  out = fopen(path, "wb");
+  if (!out) {
+    free(snap);
+    return CL_ERR_IO;
+  }
+  if (fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+    status = CL_ERR_IO;
+  for (size_t i = 0; status == CL_OK && i < hdr.count; i++) {
+    const cl_trace_slot *slot = &snap[(first + i) & inst->trace_mask];
+    cl_trace_rec_t rec = {
+        .cycle = slot->cycle,
+        .release_ns = cl_clock_to_mono_ns(clk, slot->release),
+        .wake_ns = cl_clock_to_mono_ns(clk, slot->wake),
+        .end_ns = cl_clock_to_mono_ns(clk, slot->end),
+        .ret = slot->ret,
+    };
+    if (fwrite(&rec, sizeof(rec), 1, out) != 1)
+      status = CL_ERR_IO;
+  }
+  if (fclose(out))
+    status = CL_ERR_IO;
+  free(snap);
+  return status;
+}
+
+void cl_trace_flush(cl_instanse *inst) {
+  if (!inst->trace_buf || !inst->attrs.trace_path ||
+      !atomic_load_explicit(&inst->trace_frozen, memory_order_acquire) ||
+      atomic_exchange_explicit(&inst->trace_dumped, 1, memory_order_relaxed))
+    return;
+  trace_write(inst, inst->attrs.trace_path);
+}
+
+cl_status_t cl_inst_trace_dump(struct cl_instanse_s *inst, const char *path) {
+  if (!inst->trace_buf)
+    return CL_ERR_INVAL;
+  if (!path)
+    path = inst->attrs.trace_path;
+  if (!path)
+    return CL_ERR_INVAL;
+  atomic_store_explicit(&inst->trace_frozen, 1, memory_order_relaxed);
+  return trace_write(inst, path);
+}
+
+cl_status_t cl_inst_trace_resume(struct cl_instanse_s *inst) {
+  if (!inst->trace_buf)
+    return CL_ERR_INVAL;
+  atomic_store_explicit(&inst->trace_dumped, 0, memory_order_relaxed);
+  atomic_store_explicit(&inst->trace_frozen, 0, memory_order_release);
+  return CL_OK;
+}
@@ -0,0 +1,232 @@
+// Local headers
+#include "corelock.h"
+#include "corelock_internal.h"
+
+#include <fcntl.h>
+#include <linux/watchdog.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CL_WDOG_DEF_POLL_US 1000
+
+/*
+ * Supervisor of the process. ctl serializes start and stop, lock guards the
+ * instance list and the stalled instances waiting for their actions. The
+ * actions run without the lock; acting is the instance they run for, which
+ * cl_wdog_unregister() waits out.
+ */
+static struct {
+  pthread_mutex_t ctl;
+  pthread_mutex_t lock;
+  pthread_cond_t idle;
+  cl_instanse *head;
+  cl_instanse *pending;
+  cl_instanse *acting;
+  pthread_t thread;
+  bool running;
+  atomic_int stop;
+  uint64_t poll_ns;
+  int hw_fd;
+} wdog = {
+    .ctl = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+    .hw_fd = -1,
+};
+
+void cl_wdog_register(cl_instanse *inst) {
+  pthread_mutex_lock(&wdog.lock);
+  inst->wdog_seen = atomic_load_explicit(&inst->heartbeat, memory_order_relaxed);
+  inst->wdog_since_ns = cl_mono_ns();
+  inst->wdog_fired = false;
+  inst->wdog_next = wdog.head;
+  wdog.head = inst;
+  inst->wdog_registered = true;
+  pthread_mutex_unlock(&wdog.lock);
+}
+
+void cl_wdog_unregister(cl_instanse *inst) {
+  if (!inst->wdog_registered)
+    return;
+  pthread_mutex_lock(&wdog.lock);
+  for (cl_instanse **it = &wdog.head; *it; it = &(*it)->wdog_next)
+    if (*it == inst) {
+      *it = inst->wdog_next;
+      break;
+    }
+  for (cl_instanse **it = &wdog.pending; *it; it = &(*it)->wdog_pending_next)
+    if (*it == inst) {
+      *it = inst->wdog_pending_next;
+      break;
+    }
+  /* A wdog_fn that joins its own instance runs on the supervisor */
+  while (wdog.acting == inst && !pthread_equal(pthread_self(), wdog.thread))
+    pthread_cond_wait(&wdog.idle, &wdog.lock);
+  inst->wdog_registered = false;
+  pthread_mutex_unlock(&wdog.lock);
+}
+
+/* The callback goes last: it may join and destroy the instance. */
+static void wdog_act(cl_instanse *inst) {
+  unsigned actions =
+      inst->attrs.wdog_actions ? inst->attrs.wdog_actions : CL_WDOG_NOTIFY;
+  unsigned long long cycle = inst->wdog_seen / 2;
+  uint64_t stalled_ns = inst->wdog_stalled_ns;
+
+  if (actions & CL_WDOG_DEMOTE) {
+    struct sched_param param = {.sched_priority = 0};
+    pthread_setschedparam(inst->id, SCHED_OTHER, &param);
+  }
+  if (actions & CL_WDOG_TERM)
+    cl_inst_term(inst);
+  if (actions & CL_WDOG_NOTIFY) {
+    if (inst->attrs.wdog_fn)
+      inst->attrs.wdog_fn(inst, cycle, stalled_ns, inst->attrs.wdog_arg);
+    else
+      fprintf(stderr, "Task is stalled in cycle %llu for %llu us!\n", cycle,
+              (unsigned long long)stalled_ns / 1000);
+  }
+}
+
+/* Runs the actions of the instances queued by wdog_poll(). */
+static void wdog_dispatch(void) {
+  cl_instanse *inst;
+
+  pthread_mutex_lock(&wdog.lock);
+  while ((inst = wdog.pending)) {
+    wdog.pending = inst->wdog_pending_next;
+    wdog.acting = inst;
+    pthread_mutex_unlock(&wdog.lock);
+    wdog_act(inst);
+    pthread_mutex_lock(&wdog.lock);
+  }
+  wdog.acting = NULL;
+  pthread_cond_broadcast(&wdog.idle);
+  pthread_mutex_unlock(&wdog.lock);
+}
+
+/*
+ * One pass over the supervised instances. The heartbeat is odd while a task
+ * runs, so only an odd value that did not move for the stall limit is a
+ * stall, which is queued for wdog_dispatch(). Returns true if an instance
+ * with CL_WDOG_HW is stalled.
+ */
+static bool wdog_poll(uint64_t now) {
+  bool hold = false;
+
+  pthread_mutex_lock(&wdog.lock);
+  for (cl_instanse *inst = wdog.head; inst; inst = inst->wdog_next) {
+    unsigned long long hb =
+        atomic_load_explicit(&inst->heartbeat, memory_order_relaxed);
+    if (hb != inst->wdog_seen) {
+      inst->wdog_seen = hb;
+      inst->wdog_since_ns = now;
+      inst->wdog_fired = false;
+      continue;
+    }
+    if (!(hb & 1))
+      continue;
+    if (!inst->wdog_fired &&
+        now - inst->wdog_since_ns >
+            atomic_load_explicit(&inst->wdog_limit_ns, memory_order_relaxed)) {
+      inst->wdog_fired = true;
+      inst->wdog_stalled_ns = now - inst->wdog_since_ns;
+      inst->wdog_pending_next = wdog.pending;
+      wdog.pending = inst;
+    }
+    if (inst->wdog_fired && (inst->attrs.wdog_actions & CL_WDOG_HW))
+      hold = true;
+  }
+  pthread_mutex_unlock(&wdog.lock);
+  return hold;
+}
+
+static void *supervisor_fn(void *arg) {
+  uint64_t next = cl_mono_ns();
+  CL_UNUSED(arg);
+
+  while (!atomic_load_explicit(&wdog.stop, memory_order_acquire)) {
+    struct timespec ts;
+    bool hold = wdog_poll(cl_mono_ns());
+    wdog_dispatch();
+    if (!hold && wdog.hw_fd >= 0)
+      ioctl(wdog.hw_fd, WDIOC_KEEPALIVE, 0);
+    next += wdog.poll_ns;
+    ts.tv_sec = (time_t)(next / 1000000000ULL);
+    ts.tv_nsec = (long)(next % 1000000000ULL);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  }
+  return NULL;
+}
+
+static void hw_close(void) {
+  if (wdog.hw_fd < 0)
+    return;
+  /* Magic close: disarms the device unless the driver is nowayout */
+  if (write(wdog.hw_fd, "V", 1) != 1)
+    perror("watchdog magic close");
+  close(wdog.hw_fd);
+  wdog.hw_fd = -1;
+}
+
+cl_status_t cl_wdog_start(const cl_wdog_attr_t *attrs) {
+  struct sched_param param = {.sched_priority = attrs->priority};
+  cl_status_t status = CL_OK;
+  pthread_attr_t th_attr;
+
+  pthread_mutex_lock(&wdog.ctl);
+  if (wdog.running) {
+    pthread_mutex_unlock(&wdog.ctl);
+    return CL_ERR_BUSY;
+  }
+  wdog.poll_ns =
+      (uint64_t)(attrs->poll_us ? attrs->poll_us : CL_WDOG_DEF_POLL_US) * 1000;
+  if (attrs->hw_path) {
+    int timeout = (int)attrs->hw_timeout_s;
+    wdog.hw_fd = open(attrs->hw_path, O_WRONLY | O_CLOEXEC);
+    if (wdog.hw_fd < 0 ||
+        (timeout && ioctl(wdog.hw_fd, WDIOC_SETTIMEOUT, &timeout))) {
+      hw_close();
+      pthread_mutex_unlock(&wdog.ctl);
+      return CL_ERR_IO;
+    }
+  }
+
+  pthread_attr_init(&th_attr);
+  if (attrs->cpu_mask)
+    pthread_attr_setaffinity_np(&th_attr, attrs->cpu_mask_size,
+                                attrs->cpu_mask);
+  if (attrs->sched_policy != SCHED_OTHER) {
+    pthread_attr_setinheritsched(&th_attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&th_attr, attrs->sched_policy);
+    pthread_attr_setschedparam(&th_attr, &param);
+  }
+  atomic_store_explicit(&wdog.stop, 0, memory_order_relaxed);
+  if (pthread_create(&wdog.thread, &th_attr, supervisor_fn, NULL)) {
+    hw_close();
+    status = CL_ERR_START;
+  } else {
+    wdog.running = true;
+  }
+  pthread_attr_destroy(&th_attr);
+  pthread_mutex_unlock(&wdog.ctl);
+  return status;
+}
+
+cl_status_t cl_wdog_stop(void) {
+  pthread_mutex_lock(&wdog.ctl);
+  if (!wdog.running) {
+    pthread_mutex_unlock(&wdog.ctl);
+    return CL_ERR_INVAL;
+  }
+  atomic_store_explicit(&wdog.stop, 1, memory_order_release);
+  pthread_join(wdog.thread, NULL);
+  hw_close();
+  wdog.running = false;
+  pthread_mutex_unlock(&wdog.ctl);
+  return CL_OK;
+}
@@ -0,0 +1,45 @@
+/*
+ * Minimal assertion helpers of the unit tests. A failed CHECK() reports the
+ * location and the test goes on; main() returns TEST_RESULT().
+ */
+#ifndef CORELOCK_TEST_H
+#define CORELOCK_TEST_H
+
+#include <sched.h>
+#include <stdio.h>
+
+static int test_failures;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      test_failures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EQ(lhs, rhs)                                                     \
+  do {                                                                         \
+    long long lhs_ = (long long)(lhs), rhs_ = (long long)(rhs);                \
+    if (lhs_ != rhs_) {                                                        \
+      fprintf(stderr, "%s:%d: %s == %s failed (%lld != %lld)\n", __FILE__,     \
+              __LINE__, #lhs, #rhs, lhs_, rhs_);                               \
+      test_failures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
+
+/* First CPU the test may run on, for instances started under SCHED_OTHER. */
+static inline void test_cpu(cpu_set_t *set) {
+  cpu_set_t allowed;
+  int cpu = 0;
+
+  if (!sched_getaffinity(0, sizeof(allowed), &allowed))
+    while (cpu < CPU_SETSIZE - 1 && !CPU_ISSET(cpu, &allowed))
+      cpu++;
+  CPU_ZERO(set);
+  CPU_SET(cpu, set);
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Bump allocation of the instance arena: alignment, exact fill, overflow
+ * fallbacks and reset. The instance is created but never started.
+ */
+#include "corelock.h"
+#include "corelock_internal.h"
+#include "test.h"
+
+#include <stdint.h>
+
+#define ARENA_SIZE 4096
+
+static struct cl_instanse_s *create(size_t arena_size) {
+  static cpu_set_t cpus;
+  cl_attr_t attrs = cl_make_def_attrs(1000, &cpus, sizeof(cpus));
+
+  test_cpu(&cpus);
+  attrs.sched_policy = SCHED_OTHER;
+  attrs.priority = 0;
+  attrs.arena_size = arena_size;
+  return cl_inst_create(NULL, NULL, &attrs);
+}
+
+static void destroy(struct cl_instanse_s *inst) {
+  /* Never run, so there is no thread to join */
+  atomic_store_explicit(&inst->is_joined, 1, memory_order_relaxed);
+  CHECK_EQ(cl_inst_destroy(inst), CL_OK);
+}
+
+static void test_alignment(struct cl_instanse_s *inst) {
+  unsigned char *base = cl_arena_alloc(inst, 1);
+  unsigned char *ptr;
+
+  CHECK(base);
+  CHECK((uintptr_t)base % 16 == 0);
+  /* Every block is 16-byte aligned, as malloc() would do */
+  ptr = cl_arena_alloc(inst, 1);
+  CHECK(ptr == base + 16);
+  ptr = cl_arena_alloc(inst, 17);
+  CHECK(ptr == base + 32);
+  ptr = cl_arena_alloc(inst, 1);
+  CHECK(ptr == base + 64);
+  /* Larger power of two alignments relative to the arena start */
+  ptr = cl_arena_take(inst, 8, 256);
+  CHECK(ptr == base + 256);
+  ptr = cl_arena_take(inst, 8, 1);
+  CHECK(ptr == base + 264);
+  cl_arena_reset(inst);
+  CHECK(cl_arena_alloc(inst, 1) == base);
+  cl_arena_reset(inst);
+}
+
+static void test_overflow(struct cl_instanse_s *inst) {
+  unsigned char *base = cl_arena_alloc(inst, 16);
+  cl_arena_info_t info;
+
+  /* The rest of the arena fits exactly */
+  CHECK(cl_arena_alloc(inst, ARENA_SIZE - 16) == base + 16);
+  CHECK(!cl_arena_alloc(inst, 1));
+  cl_arena_reset(inst);
+
+  CHECK(!cl_arena_alloc(inst, ARENA_SIZE + 1));
+  /* A size near SIZE_MAX must not wrap past the bounds check */
+  CHECK(!cl_arena_alloc(inst, SIZE_MAX - 8));
+  CHECK(cl_arena_alloc(inst, ARENA_SIZE - 32) == base);
+  /* The aligned offset itself lies past the end */
+  CHECK(!cl_arena_take(inst, 1, ARENA_SIZE * 2));
+
+  CHECK_EQ(cl_inst_get_arena_info(inst, &info), CL_OK);
+  CHECK_EQ(info.size, ARENA_SIZE);
+  CHECK_EQ(info.peak, ARENA_SIZE);
+  CHECK_EQ(info.fallbacks, 4);
+}
+
+static void test_no_arena(void) {
+  struct cl_instanse_s *inst = create(0);
+  cl_arena_info_t info;
+
+  CHECK(inst);
+  if (!inst)
+    return;
+  CHECK(!cl_arena_alloc(inst, 1));
+  CHECK_EQ(cl_inst_get_arena_info(inst, &info), CL_ERR_INVAL);
+  destroy(inst);
+}
+
+int main(void) {
+  struct cl_instanse_s *inst = create(ARENA_SIZE);
+
+  CHECK(inst);
+  if (inst) {
+    test_alignment(inst);
+    test_overflow(inst);
+    destroy(inst);
+  }
+  test_no_arena();
+  return TEST_RESULT();
+}
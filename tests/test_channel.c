@@ -0,0 +1,93 @@
+/*
+ * Single-thread semantics of the triple buffer and the seqlock channel.
+ */
+#include "corelock.h"
+#include "corelock_internal.h"
+#include "test.h"
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+  int value;
+  char pad[100];
+} msg_t;
+
+static void publish(struct cl_tbuf_s *tb, int value) {
+  msg_t *msg = cl_tbuf_write_buf(tb);
+  msg->value = value;
+  cl_tbuf_publish(tb);
+}
+
+static void test_tbuf(void) {
+  struct cl_tbuf_s *tb = cl_tbuf_create(sizeof(msg_t));
+  const msg_t *msg, *held;
+  bool updated = true;
+
+  CHECK(!cl_tbuf_create(0));
+  CHECK(tb);
+  if (!tb)
+    return;
+  CHECK((uintptr_t)cl_tbuf_write_buf(tb) % CL_CACHE_LINE == 0);
+
+  /* Nothing published yet: a zero-filled front buffer */
+  msg = cl_tbuf_read(tb, &updated);
+  CHECK(!updated);
+  CHECK_EQ(msg->value, 0);
+
+  publish(tb, 1);
+  msg = cl_tbuf_read(tb, &updated);
+  CHECK(updated);
+  CHECK_EQ(msg->value, 1);
+  msg = cl_tbuf_read(tb, &updated);
+  CHECK(!updated);
+  CHECK_EQ(msg->value, 1);
+
+  /* The reader skips to the latest message, the held one stays intact */
+  held = msg;
+  publish(tb, 2);
+  publish(tb, 3);
+  CHECK_EQ(held->value, 1);
+  /* The back buffer holds the message before the last one */
+  CHECK_EQ(((msg_t *)cl_tbuf_write_buf(tb))->value, 2);
+  msg = cl_tbuf_read(tb, &updated);
+  CHECK(updated);
+  CHECK_EQ(msg->value, 3);
+  CHECK((uintptr_t)msg % CL_CACHE_LINE == 0);
+  cl_tbuf_destroy(tb);
+}
+
+static void test_seqch(void) {
+  struct cl_seqch_s *ch = cl_seqch_create(sizeof(msg_t));
+  msg_t in, out;
+
+  CHECK(!cl_seqch_create(0));
+  CHECK(ch);
+  if (!ch)
+    return;
+
+  memset(&out, 0xff, sizeof(out));
+  CHECK_EQ(cl_seqch_read(ch, &out), 0);
+  CHECK_EQ(out.value, 0);
+
+  memset(&in, 0, sizeof(in));
+  for (int i = 1; i <= 3; i++) {
+    in.value = i;
+    memset(in.pad, 'a' + i, sizeof(in.pad));
+    cl_seqch_write(ch, &in);
+    /* Even sequence numbers, two per write */
+    CHECK_EQ(cl_seqch_read(ch, &out), 2 * i);
+    CHECK(!memcmp(&in, &out, sizeof(in)));
+  }
+
+  memset(&out, 0, sizeof(out));
+  CHECK_EQ(cl_seqch_try_read(ch, &out), CL_OK);
+  CHECK(!memcmp(&in, &out, sizeof(in)));
+  cl_seqch_destroy(ch);
+}
+
+int main(void) {
+  test_tbuf();
+  test_seqch();
+  return TEST_RESULT();
+}
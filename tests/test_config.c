@@ -0,0 +1,156 @@
+/*
+ * INI loader: parse and validation errors reject the whole file, a valid
+ * file creates its instances with the symbols exported by this executable.
+ */
+#include "corelock.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int cpu;
+
+long cfg_test_step(void *arg) {
+  (void)arg;
+  return 0;
+}
+
+int cfg_test_arg;
+
+/* Loads @p text from a temporary file; "$cpu" expands to the test CPU. */
+static struct cl_config_s *load(const char *text) {
+  char path[] = "/tmp/corelock_test_XXXXXX";
+  struct cl_config_s *cfg;
+  int fd = mkstemp(path);
+  FILE *out;
+
+  CHECK(fd >= 0);
+  if (fd < 0)
+    return NULL;
+  out = fdopen(fd, "w");
+  for (const char *pos = text; *pos; pos++)
+    if (!strncmp(pos, "$cpu", 4)) {
+      fprintf(out, "%d", cpu);
+      pos += 3;
+    } else {
+      fputc(*pos, out);
+    }
+  fclose(out);
+  cfg = cl_config_load(path);
+  unlink(path);
+  return cfg;
+}
+
+#define TASK "[t]\nsymbol = cfg_test_step\nperiod_us = 1000\ncpus = $cpu\n"
+
+static void check_rejected(const char *text) {
+  struct cl_config_s *cfg = load(text);
+
+  CHECK(!cfg);
+  if (cfg) {
+    fprintf(stderr, "accepted:\n%s\n", text);
+    cl_config_destroy(cfg);
+  }
+}
+
+static void test_parse_errors(void) {
+  CHECK(!cl_config_load("/nonexistent/corelock.ini"));
+  check_rejected("[t\n");
+  check_rejected("[t] x\n");
+  check_rejected("[]\n");
+  check_rejected("period_us = 1000\n");
+  check_rejected(TASK "no value here\n");
+  check_rejected(TASK "unknown_key = 1\n");
+  check_rejected("[corelock]\nunknown_key = 1\n");
+  check_rejected(TASK "[t]\n");
+  check_rejected(TASK "priority = high\n");
+  check_rejected(TASK "overrun = sometimes\n");
+  check_rejected(TASK "policy = batch\n");
+  check_rejected(TASK "stats = maybe\n");
+  check_rejected(TASK "stop_time = -1\n");
+  check_rejected(TASK "warmup_cycles = 4294967296\n");
+  check_rejected("[t]\nsymbol = cfg_test_step\nperiod_us = 1k\ncpus = $cpu\n");
+  check_rejected("[t]\nsymbol = cfg_test_step\nperiod_us = -5\ncpus = $cpu\n");
+  check_rejected("[t]\nsymbol = cfg_test_step\nperiod_us = 1000\ncpus = x\n");
+  check_rejected("[corelock]\ngroup = perhaps\n" TASK);
+}
+
+static void test_check_errors(void) {
+  check_rejected("[t]\nperiod_us = 1000\ncpus = $cpu\n");
+  check_rejected("[t]\nsymbol = cfg_test_step\ncpus = $cpu\n");
+  check_rejected("[t]\nsymbol = cfg_test_step\nperiod_us = 1000\n");
+  check_rejected(TASK "phase_us = 100\n");
+  check_rejected("[corelock]\ngroup = false\n");
+  check_rejected("");
+  /* Symbols are resolved after the checks, still before any start */
+  check_rejected("[t]\nsymbol = cfg_test_missing\nperiod_us = 1000\n"
+                 "cpus = $cpu\n");
+  check_rejected(TASK "arg = cfg_test_missing\n");
+}
+
+static void test_utilization(void) {
+  const char *text = "[corelock]\nmax_util_pct = %s\n"
+                     "[a]\nsymbol = cfg_test_step\nperiod_us = 1000\n"
+                     "cpus = $cpu\npolicy = other\nwcet_us = 600\n"
+                     "[b]\nsymbol = cfg_test_step\nperiod_us = 2000\n"
+                     "cpus = $cpu\npolicy = other\nwcet_us = 900\n";
+  struct cl_config_s *cfg;
+  char buf[512];
+
+  /* 60% + 45% on one CPU */
+  snprintf(buf, sizeof(buf), text, "100");
+  check_rejected(buf);
+  snprintf(buf, sizeof(buf), text, "105");
+  cfg = load(buf);
+  CHECK(cfg);
+  if (cfg)
+    CHECK_EQ(cl_config_destroy(cfg), CL_OK);
+}
+
+static void test_valid(void) {
+  struct cl_config_s *cfg = load(
+      "# leading comment\n"
+      "[corelock]\n"
+      "group = false ; inline comment\n"
+      "\n"
+      "[fast]\n"
+      "symbol = cfg_test_step   # inline comment\n"
+      "arg = cfg_test_arg\n"
+      "period_us = 1000\n"
+      "cpus = $cpu\n"
+      "policy = other\n"
+      "overrun = skip\n"
+      "stats = yes\n"
+      "[ slow ]\n"
+      "symbol=cfg_test_step\n"
+      "period_us=10000\n"
+      "cpus=$cpu\n"
+      "policy=other\n"
+      "overrun=stop_after\n"
+      "stop_limit=3\n");
+
+  CHECK(cfg);
+  if (!cfg)
+    return;
+  CHECK_EQ(cl_config_size(cfg), 2);
+  CHECK(cl_config_inst(cfg, 0));
+  CHECK(cl_config_find(cfg, "fast") == cl_config_inst(cfg, 0));
+  CHECK(cl_config_find(cfg, "slow") == cl_config_inst(cfg, 1));
+  CHECK(!cl_config_find(cfg, "missing"));
+  CHECK(!cl_config_inst(cfg, 2));
+  CHECK_EQ(cl_config_destroy(cfg), CL_OK);
+}
+
+int main(void) {
+  cpu_set_t cpus;
+
+  test_cpu(&cpus);
+  while (!CPU_ISSET(cpu, &cpus))
+    cpu++;
+  test_parse_errors();
+  test_check_errors();
+  test_utilization();
+  test_valid();
+  return TEST_RESULT();
+}
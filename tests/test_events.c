@@ -0,0 +1,72 @@
+/*
+ * SPSC event ring on one thread: FIFO order across the wrap, partial drains,
+ * the capacity rounded up to a power of two and the drop counter.
+ */
+#include "corelock.h"
+#include "corelock_internal.h"
+#include "test.h"
+
+static struct cl_instanse_s *create(size_t ring_size) {
+  static cpu_set_t cpus;
+  cl_attr_t attrs = cl_make_def_attrs(1000, &cpus, sizeof(cpus));
+
+  test_cpu(&cpus);
+  attrs.sched_policy = SCHED_OTHER;
+  attrs.priority = 0;
+  attrs.event_ring_size = ring_size;
+  return cl_inst_create(NULL, NULL, &attrs);
+}
+
+static void destroy(struct cl_instanse_s *inst) {
+  /* Never run, so there is no thread to join */
+  atomic_store_explicit(&inst->is_joined, 1, memory_order_relaxed);
+  CHECK_EQ(cl_inst_destroy(inst), CL_OK);
+}
+
+static void emit(struct cl_instanse_s *inst, unsigned long long cycle) {
+  cl_event_t ev = {.type = CL_EVENT_OVERRUN, .cycle = cycle};
+  cl_event_emit(inst, &ev);
+}
+
+int main(void) {
+  /* Rounded up to 8 slots */
+  struct cl_instanse_s *inst = create(5);
+  unsigned long long next = 0;
+  cl_event_t out[16];
+  size_t count;
+
+  CHECK(inst);
+  if (!inst)
+    return TEST_RESULT();
+  CHECK_EQ(cl_inst_drain_events(inst, out, 16), 0);
+
+  /* Several laps around the ring keep the order */
+  for (unsigned long long cycle = 0; cycle < 40; cycle += 5) {
+    for (unsigned long long i = 0; i < 5; i++)
+      emit(inst, cycle + i);
+    /* Two partial drains per lap */
+    count = cl_inst_drain_events(inst, out, 3);
+    CHECK_EQ(count, 3);
+    count += cl_inst_drain_events(inst, out + 3, 16);
+    CHECK_EQ(count, 5);
+    for (size_t i = 0; i < count; i++) {
+      CHECK_EQ(out[i].type, CL_EVENT_OVERRUN);
+      CHECK_EQ(out[i].cycle, next++);
+    }
+  }
+  CHECK_EQ(cl_inst_events_dropped(inst), 0);
+
+  /* A full ring drops the newest events and counts them */
+  for (unsigned long long i = 0; i < 11; i++)
+    emit(inst, 100 + i);
+  CHECK_EQ(cl_inst_events_dropped(inst), 3);
+  count = cl_inst_drain_events(inst, out, 16);
+  CHECK_EQ(count, 8);
+  CHECK_EQ(out[0].cycle, 100);
+  CHECK_EQ(out[7].cycle, 107);
+  emit(inst, 200);
+  CHECK_EQ(cl_inst_drain_events(inst, out, 16), 1);
+  CHECK_EQ(out[0].cycle, 200);
+  destroy(inst);
+  return TEST_RESULT();
+}
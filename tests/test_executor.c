@@ -0,0 +1,118 @@
+/*
+ * Schedule of cl_executor: the minor frame is the GCD of the task periods,
+ * each task runs every period / minor frames starting with frame 0, and the
+ * tasks of a frame run in order of increasing period.
+ */
+#include "corelock.h"
+#include "test.h"
+
+#define MAX_CALLS 64
+
+static int calls[MAX_CALLS];
+static size_t n_calls;
+static int runs[2];
+
+static long task(void *arg) {
+  int id = (int)(long)arg;
+
+  runs[id]++;
+  if (n_calls < MAX_CALLS)
+    calls[n_calls++] = id;
+  return 0;
+}
+
+static cl_attr_t exec_attrs(cpu_set_t *cpus, double stop_time) {
+  cl_attr_t attrs = cl_make_def_attrs(0, cpus, sizeof(*cpus));
+
+  attrs.sched_policy = SCHED_OTHER;
+  attrs.priority = 0;
+  /* Frames of a loaded test machine may be late, none may be dropped */
+  attrs.or_bh = CL_OVERRUN_BH_IGNORE;
+  attrs.stop_time = stop_time;
+  attrs.collect_stats = true;
+  return attrs;
+}
+
+static void run_schedule(size_t fast_us, size_t slow_us, double stop_time,
+                         unsigned long long frames, int fast_runs,
+                         int slow_runs) {
+  cl_attr_t task_attrs = cl_make_def_attrs(0, NULL, 0);
+  struct cl_executor_s *exec;
+  cl_stats_t stats;
+  cpu_set_t cpus;
+  cl_attr_t attrs;
+  long ret = -1;
+
+  test_cpu(&cpus);
+  attrs = exec_attrs(&cpus, stop_time);
+  n_calls = 0;
+  runs[0] = runs[1] = 0;
+  exec = cl_exec_create(&attrs);
+  CHECK(exec);
+  if (!exec)
+    return;
+  task_attrs.or_bh = CL_OVERRUN_BH_IGNORE;
+  /* Added slow first, the fast task still runs first in a frame */
+  task_attrs.period_us = slow_us;
+  CHECK_EQ(cl_exec_add(exec, task, (void *)1L, &task_attrs), CL_OK);
+  task_attrs.period_us = fast_us;
+  CHECK_EQ(cl_exec_add(exec, task, (void *)0L, &task_attrs), CL_OK);
+
+  CHECK_EQ(cl_exec_run(exec), CL_OK);
+  CHECK_EQ(cl_exec_join(exec, &ret), CL_OK);
+  CHECK_EQ(ret, 0);
+  CHECK_EQ(cl_inst_get_stats(cl_exec_get_inst(exec), &stats), CL_OK);
+  CHECK_EQ(stats.cycles, frames);
+  CHECK_EQ(runs[0], fast_runs);
+  CHECK_EQ(runs[1], slow_runs);
+  CHECK(n_calls >= 2);
+  CHECK_EQ(calls[0], 0);
+  CHECK_EQ(calls[1], 1);
+  CHECK_EQ(cl_exec_destroy(exec), CL_OK);
+}
+
+static void test_rejects(void) {
+  cl_attr_t task_attrs = cl_make_def_attrs(1000, NULL, 0);
+  struct cl_executor_s *exec;
+  cpu_set_t cpus;
+  cl_attr_t attrs;
+
+  test_cpu(&cpus);
+  attrs = exec_attrs(&cpus, 0.01);
+  attrs.or_bh = CL_OVERRUN_BH_SKIP;
+  CHECK(!cl_exec_create(&attrs));
+  attrs.or_bh = CL_OVERRUN_BH_CATCHUP_N;
+  CHECK(!cl_exec_create(&attrs));
+  attrs.or_bh = CL_OVERRUN_BH_IGNORE;
+  attrs.warmup_fn = task;
+  CHECK(!cl_exec_create(&attrs));
+  attrs.warmup_fn = NULL;
+
+  exec = cl_exec_create(&attrs);
+  CHECK(exec);
+  if (!exec)
+    return;
+  CHECK_EQ(cl_exec_run(exec), CL_ERR_INVAL);
+  task_attrs.or_bh = CL_OVERRUN_BH_SKIP;
+  CHECK_EQ(cl_exec_add(exec, task, NULL, &task_attrs), CL_ERR_INVAL);
+  task_attrs.or_bh = CL_OVERRUN_BH_CATCHUP_N;
+  CHECK_EQ(cl_exec_add(exec, task, NULL, &task_attrs), CL_ERR_INVAL);
+  task_attrs.or_bh = CL_OVERRUN_BH_STOP_AFTER_K;
+  task_attrs.or_stop_limit = 0;
+  CHECK_EQ(cl_exec_add(exec, task, NULL, &task_attrs), CL_ERR_INVAL);
+  task_attrs.or_bh = CL_OVERRUN_BH_STOP;
+  task_attrs.period_us = 0;
+  CHECK_EQ(cl_exec_add(exec, task, NULL, &task_attrs), CL_ERR_INVAL);
+  CHECK_EQ(cl_exec_destroy(exec), CL_OK);
+}
+
+int main(void) {
+  /* Minor frame 1000 us: the fast task every 2, the slow one every 3 frames */
+  run_schedule(2000, 3000, 0.012, 12, 6, 4);
+  /* Same ratios on a 2000 us frame, so half the frames for twice the time */
+  run_schedule(4000, 6000, 0.024, 12, 6, 4);
+  /* A period that divides the other one is the frame itself */
+  run_schedule(1000, 7000, 0.014, 14, 14, 2);
+  test_rejects();
+  return TEST_RESULT();
+}
@@ -0,0 +1,81 @@
+/*
+ * Deadline realignment of CL_OVERRUN_BH_SKIP and CL_OVERRUN_BH_CATCHUP_N on
+ * plain tick values.
+ */
+#include "corelock.h"
+#include "corelock_internal.h"
+#include "test.h"
+
+#define PERIOD 100
+
+static void test_realign(void) {
+  cl_overrun_state st = {0};
+  uint64_t next = 1000;
+
+  /* Slightly late: the next boundary is one period on */
+  cl_or_realign(&st, PERIOD, 1001, &next);
+  CHECK_EQ(next, 1100);
+  CHECK_EQ(st.skipped, 1);
+
+  /* Ending on a boundary does not release at that boundary */
+  cl_or_realign(&st, PERIOD, 1100, &next);
+  CHECK_EQ(next, 1200);
+  CHECK_EQ(st.skipped, 2);
+
+  /* Several periods late, the grid stays at multiples of the period */
+  cl_or_realign(&st, PERIOD, 1550, &next);
+  CHECK_EQ(next, 1600);
+  CHECK_EQ(st.skipped, 6);
+}
+
+static void test_realign_wrap(void) {
+  cl_overrun_state st = {0};
+  uint64_t start = UINT64_MAX - 50;
+  uint64_t next = start;
+
+  /* Raw counters may wrap, the unsigned distance still counts */
+  cl_or_realign(&st, PERIOD, start + 250, &next);
+  CHECK(next == start + 300);
+  CHECK_EQ(st.skipped, 3);
+}
+
+static void test_catchup(void) {
+  cl_overrun_state st = {0};
+  uint64_t next = 1000;
+
+  /* Up to max late cycles keep the deadline and run back-to-back */
+  cl_or_catchup(&st, 2, PERIOD, 1500, &next);
+  CHECK_EQ(next, 1000);
+  cl_or_catchup(&st, 2, PERIOD, 1500, &next);
+  CHECK_EQ(next, 1000);
+  CHECK_EQ(st.catchup_used, 2);
+  CHECK_EQ(st.skipped, 0);
+
+  /* The next one realigns and starts a new budget */
+  cl_or_catchup(&st, 2, PERIOD, 1500, &next);
+  CHECK_EQ(next, 1600);
+  CHECK_EQ(st.skipped, 6);
+  CHECK_EQ(st.catchup_used, 0);
+  cl_or_catchup(&st, 2, PERIOD, 1650, &next);
+  CHECK_EQ(next, 1600);
+  CHECK_EQ(st.catchup_used, 1);
+}
+
+static void test_catchup_zero(void) {
+  cl_overrun_state st = {0};
+  uint64_t next = 1000;
+
+  /* Without a budget CATCHUP_N is SKIP */
+  cl_or_catchup(&st, 0, PERIOD, 1250, &next);
+  CHECK_EQ(next, 1300);
+  CHECK_EQ(st.skipped, 3);
+  CHECK_EQ(st.catchup_used, 0);
+}
+
+int main(void) {
+  test_realign();
+  test_realign_wrap();
+  test_catchup();
+  test_catchup_zero();
+  return TEST_RESULT();
+}
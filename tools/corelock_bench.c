@@ -0,0 +1,290 @@
+/*
+ * corelock_bench: measures the wakeup latency the library delivers over a
+ * sweep of periods, wait modes, clock sources and synthetic task loads.
+ *
+ * Every combination runs for a fixed duration on one core and produces one
+ * CSV line or JSON object. Percentiles come from the log2 latency histogram
+ * of cl_stats_t and are reported as the upper bound of the bucket holding
+ * them, clamped to the observed maximum.
+ */
+#include "corelock.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_LIST 16
+
+typedef struct {
+  size_t vals[BENCH_MAX_LIST];
+  size_t n;
+} bench_list;
+
+typedef struct {
+  size_t spin_us;
+  unsigned char *mem;
+  size_t mem_len;
+} bench_load;
+
+typedef struct {
+  size_t period_us;
+  cl_wait_mode wait_mode;
+  cl_clock_source clock;
+  size_t spin_us;
+  size_t mem_kb;
+} bench_case;
+
+static const char *wait_names[] = {"sleep", "spin", "hybrid"};
+static const char *clock_names[] = {"monotonic", "counter"};
+
+static uint64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static long bench_task(void *arg) {
+  bench_load *load = arg;
+
+  if (load->spin_us) {
+    uint64_t end = mono_ns() + load->spin_us * 1000;
+    while (mono_ns() < end)
+      ;
+  }
+  for (size_t off = 0; off < load->mem_len; off += 64)
+    load->mem[off]++;
+  return 0;
+}
+
+/* Upper bound of the histogram bucket holding the @p permille quantile. */
+static long long hist_quantile(const cl_stats_t *st, unsigned permille) {
+  unsigned long long rank = (st->cycles * permille + 999) / 1000;
+  unsigned long long seen = 0;
+  long long bound;
+
+  for (unsigned b = 0; b < CL_STATS_HIST_BUCKETS; b++) {
+    seen += st->latency_hist[b];
+    if (seen < rank)
+      continue;
+    if (b == CL_STATS_HIST_BUCKETS - 1)
+      return st->wakeup_latency.max_ns;
+    bound = (2LL << b) - 1;
+    return bound < st->wakeup_latency.max_ns ? bound
+                                             : st->wakeup_latency.max_ns;
+  }
+  return st->wakeup_latency.max_ns;
+}
+
+static bool parse_list(const char *arg, bench_list *list) {
+  char *end;
+
+  list->n = 0;
+  while (*arg) {
+    if (list->n == BENCH_MAX_LIST)
+      return false;
+    list->vals[list->n++] = strtoul(arg, &end, 10);
+    if (end == arg || (*end && *end != ','))
+      return false;
+    arg = *end ? end + 1 : end;
+  }
+  return list->n > 0;
+}
+
+static bool parse_names(const char *arg, const char **names, size_t n_names,
+                        bench_list *list) {
+  char buf[64];
+  size_t len;
+
+  list->n = 0;
+  while (*arg) {
+    len = strcspn(arg, ",");
+    if (len >= sizeof(buf) || list->n == BENCH_MAX_LIST)
+      return false;
+    memcpy(buf, arg, len);
+    buf[len] = '\0';
+    size_t i = 0;
+    while (i < n_names && strcmp(buf, names[i]))
+      i++;
+    if (i == n_names)
+      return false;
+    list->vals[list->n++] = i;
+    arg += len + (arg[len] == ',');
+  }
+  return list->n > 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -c CPU       core to run on (default 0)\n"
+          "  -d SEC       duration of every run (default 1)\n"
+          "  -p LIST      periods in us (default 10,100,1000,10000)\n"
+          "  -w LIST      wait modes: sleep,spin,hybrid (default all)\n"
+          "  -k LIST      clocks: monotonic,counter (default all)\n"
+          "  -s LIST      task spin load in us (default 0)\n"
+          "  -m LIST      task memory load in KB (default 0)\n"
+          "  -M US        hybrid spin margin (default 20)\n"
+          "  -P PRIO      SCHED_FIFO priority, 0 for SCHED_OTHER (default 80)\n"
+          "  -W N         warm-up cycles (default 100)\n"
+          "  -l           lock memory with mlockall()\n"
+          "  -f FORMAT    csv or json (default csv)\n",
+          prog);
+}
+
+static bool run_case(const bench_case *bc, const cl_attr_t *base,
+                     cl_stats_t *st) {
+  cl_attr_t attrs = *base;
+  bench_load load = {.spin_us = bc->spin_us, .mem_len = bc->mem_kb * 1024};
+  struct cl_instanse_s *inst;
+  bool ok = false;
+
+  if (load.mem_len && !(load.mem = calloc(1, load.mem_len)))
+    return false;
+  attrs.period_us = bc->period_us;
+  attrs.wait_mode = bc->wait_mode;
+  attrs.clock_source = bc->clock;
+  attrs.prefault_addr = load.mem;
+  attrs.prefault_len = load.mem_len;
+
+  inst = cl_inst_create(bench_task, &load, &attrs);
+  if (inst) {
+    if (cl_inst_run(inst) == CL_OK && cl_inst_join(inst, NULL) == CL_OK)
+      ok = cl_inst_get_stats(inst, st) == CL_OK;
+    cl_inst_destroy(inst);
+  }
+  free(load.mem);
+  return ok;
+}
+
+static void print_case(const bench_case *bc, const cl_stats_t *st, bool json,
+                       bool first) {
+  const char *fmt =
+      json ? "%s\n  {\"period_us\": %zu, \"wait_mode\": \"%s\", "
+             "\"clock\": \"%s\", \"spin_us\": %zu, \"mem_kb\": %zu, "
+             "\"cycles\": %llu, \"overruns\": %llu, \"min_ns\": %lld, "
+             "\"avg_ns\": %lld, \"max_ns\": %lld, \"p99_ns\": %lld, "
+             "\"p999_ns\": %lld}"
+           : "%s%zu,%s,%s,%zu,%zu,%llu,%llu,%lld,%lld,%lld,%lld,%lld\n";
+
+  printf(fmt, json ? (first ? "" : ",") : "", bc->period_us,
+         wait_names[bc->wait_mode], clock_names[bc->clock], bc->spin_us,
+         bc->mem_kb, st->cycles, st->overruns, st->wakeup_latency.min_ns,
+         st->wakeup_latency.mean_ns, st->wakeup_latency.max_ns,
+         hist_quantile(st, 990), hist_quantile(st, 999));
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  bench_list periods = {.vals = {10, 100, 1000, 10000}, .n = 4};
+  bench_list waits = {.vals = {CL_WAIT_SLEEP, CL_WAIT_SPIN, CL_WAIT_HYBRID},
+                      .n = 3};
+  bench_list clocks = {.vals = {CL_CLOCK_MONOTONIC, CL_CLOCK_CPU_COUNTER},
+                       .n = 2};
+  bench_list spins = {.vals = {0}, .n = 1};
+  bench_list mems = {.vals = {0}, .n = 1};
+  int cpu = 0, prio = 80, opt;
+  double duration = 1;
+  size_t margin_us = 20;
+  unsigned warmup = 100;
+  bool json = false, lock = false, first = true;
+  cpu_set_t mask;
+  cl_stats_t st;
+
+  while ((opt = getopt(argc, argv, "c:d:p:w:k:s:m:M:P:W:f:lh")) != -1) {
+    bool ok = true;
+    switch (opt) {
+    case 'c':
+      cpu = atoi(optarg);
+      break;
+    case 'd':
+      duration = atof(optarg);
+      ok = duration > 0;
+      break;
+    case 'p':
+      ok = parse_list(optarg, &periods);
+      break;
+    case 'w':
+      ok = parse_names(optarg, wait_names, 3, &waits);
+      break;
+    case 'k':
+      ok = parse_names(optarg, clock_names, 2, &clocks);
+      break;
+    case 's':
+      ok = parse_list(optarg, &spins);
+      break;
+    case 'm':
+      ok = parse_list(optarg, &mems);
+      break;
+    case 'M':
+      margin_us = strtoul(optarg, NULL, 10);
+      break;
+    case 'P':
+      prio = atoi(optarg);
+      break;
+    case 'W':
+      warmup = strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      lock = true;
+      break;
+    case 'f':
+      json = !strcmp(optarg, "json");
+      ok = json || !strcmp(optarg, "csv");
+      break;
+    default:
+      ok = false;
+      break;
+    }
+    if (!ok) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  CPU_ZERO(&mask);
+  CPU_SET(cpu, &mask);
+  cl_attr_t base = cl_make_def_attrs(0, &mask, sizeof(mask));
+  base.priority = prio;
+  base.sched_policy = prio ? SCHED_FIFO : SCHED_OTHER;
+  base.or_bh = CL_OVERRUN_BH_IGNORE;
+  base.stop_time = duration;
+  base.collect_stats = true;
+  base.spin_margin_us = margin_us;
+  base.warmup_cycles = warmup;
+  base.lock_memory = lock;
+  /* Events go to an undrained ring so stderr stays quiet between runs */
+  base.event_ring_size = 16;
+
+  if (json)
+    printf("[");
+  else
+    printf("period_us,wait_mode,clock,spin_us,mem_kb,cycles,overruns,min_ns,"
+           "avg_ns,max_ns,p99_ns,p999_ns\n");
+  for (size_t p = 0; p < periods.n; p++)
+    for (size_t w = 0; w < waits.n; w++)
+      for (size_t k = 0; k < clocks.n; k++)
+        for (size_t s = 0; s < spins.n; s++)
+          for (size_t m = 0; m < mems.n; m++) {
+            bench_case bc = {
+                .period_us = periods.vals[p],
+                .wait_mode = (cl_wait_mode)waits.vals[w],
+                .clock = (cl_clock_source)clocks.vals[k],
+                .spin_us = spins.vals[s],
+                .mem_kb = mems.vals[m],
+            };
+            if (!run_case(&bc, &base, &st)) {
+              fprintf(stderr, "run failed: period %zu us, %s, %s\n",
+                      bc.period_us, wait_names[bc.wait_mode],
+                      clock_names[bc.clock]);
+              continue;
+            }
+            print_case(&bc, &st, json, first);
+            first = false;
+          }
+  if (json)
+    printf("\n]\n");
+  return 0;
+}
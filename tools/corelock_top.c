@@ -0,0 +1,118 @@
+/*
+ * corelock_top: polls the shared memory status segments of running
+ * instances (cl_attr_t.shm_name) and prints one line per instance. Needs no
+ * privileges and never blocks the RT threads it watches.
+ *
+ * Without names every /dev/shm/corelock.* segment is shown.
+ */
+#include "corelock.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TOP_MAX_INSTS 64
+#define TOP_PREFIX "corelock."
+
+static const char *state_names[] = {"created", "running", "finished"};
+
+static uint64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t scan_names(char names[][NAME_MAX + 1], size_t max) {
+  size_t n = 0;
+  struct dirent *ent;
+  DIR *dir = opendir("/dev/shm");
+
+  if (!dir)
+    return 0;
+  while (n < max && (ent = readdir(dir)))
+    if (!strncmp(ent->d_name, TOP_PREFIX, strlen(TOP_PREFIX)))
+      snprintf(names[n++], NAME_MAX + 1, "%s",
+               ent->d_name + strlen(TOP_PREFIX));
+  closedir(dir);
+  return n;
+}
+
+static void print_inst(const char *name, uint64_t now) {
+  const cl_shm_status_t *seg;
+  cl_shm_status_t st;
+  cl_status_t res = cl_shm_attach(name, &seg);
+
+  if (res != CL_OK) {
+    printf("%-16s %s\n", name, res == CL_ERR_IO ? "gone" : "bad segment");
+    return;
+  }
+  res = cl_shm_read(seg, &st);
+  cl_shm_detach(seg);
+  if (res != CL_OK) {
+    printf("%-16s busy\n", name);
+    return;
+  }
+  printf("%-16s %-8s %7d %4d %8llu %4d %12llu %9llu %9lld %9lld %9lld %8llu\n",
+         name, st.state <= CL_SHM_FINISHED ? state_names[st.state] : "?",
+         st.pid, st.cpu, (unsigned long long)st.period_us, st.priority,
+         (unsigned long long)st.cycle, (unsigned long long)st.overruns,
+         (long long)st.latency_mean_ns, (long long)st.latency_max_ns,
+         (long long)st.exec_max_ns,
+         (unsigned long long)(now - st.update_ns) / 1000000);
+}
+
+int main(int argc, char *argv[]) {
+  static char names[TOP_MAX_INSTS][NAME_MAX + 1];
+  unsigned interval_ms = 1000;
+  long count = 0;
+  bool clear;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:n:h")) != -1) {
+    switch (opt) {
+    case 'i':
+      interval_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 'n':
+      count = strtol(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-i MS] [-n COUNT] [NAME...]\n"
+              "  -i MS      refresh interval (default 1000)\n"
+              "  -n COUNT   number of refreshes, 0 for endless (default 0)\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  clear = isatty(STDOUT_FILENO) && count != 1;
+
+  for (long iter = 0; !count || iter < count; iter++) {
+    size_t n = 0;
+    uint64_t now;
+
+    if (iter)
+      usleep(interval_ms * 1000);
+    if (optind < argc) {
+      for (int i = optind; i < argc && n < TOP_MAX_INSTS; i++)
+        snprintf(names[n++], NAME_MAX + 1, "%s", argv[i]);
+    } else {
+      n = scan_names(names, TOP_MAX_INSTS);
+    }
+
+    now = mono_ns();
+    if (clear)
+      printf("\033[H\033[J");
+    printf("%-16s %-8s %7s %4s %8s %4s %12s %9s %9s %9s %9s %8s\n", "NAME",
+           "STATE", "PID", "CPU", "PERIOD", "PRIO", "CYCLES", "OVERRUNS",
+           "LAT_AVG", "LAT_MAX", "EXEC_MAX", "AGE_MS");
+    for (size_t i = 0; i < n; i++)
+      print_inst(names[i], now);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * corelock_trace2json: converts a flight recorder dump (cl_attr_t.trace_path,
+ * cl_inst_trace_dump()) to Chrome trace JSON, loadable by chrome://tracing
+ * and ui.perfetto.dev.
+ *
+ * Every cycle becomes a complete event spanning the task, the wakeup latency
+ * a counter track, and cycles that ended after release + period an instant
+ * "overrun" marker.
+ */
+#include "corelock.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static double rel_us(uint64_t ns, uint64_t base) {
+  return (double)(int64_t)(ns - base) / 1e3;
+}
+
+int main(int argc, char *argv[]) {
+  cl_trace_header_t hdr;
+  cl_trace_rec_t rec;
+  FILE *in, *out = stdout;
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s TRACE [OUT.json]\n", argv[0]);
+    return 1;
+  }
+  in = fopen(argv[1], "rb");
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+  if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+      memcmp(hdr.magic, CL_TRACE_MAGIC, sizeof(CL_TRACE_MAGIC)) ||
+      hdr.version != CL_TRACE_VERSION || hdr.rec_size != sizeof(rec)) {
+    fprintf(stderr, "%s: not a corelock trace of version %d\n", argv[1],
+            CL_TRACE_VERSION);
+    fclose(in);
+    return 1;
+  }
+  if (argc > 2 && !(out = fopen(argv[2], "w"))) {
+    perror(argv[2]);
+    fclose(in);
+    return 1;
+  }
+
+  fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  fprintf(out, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+               "\"args\": {\"name\": \"corelock\"}}");
+  for (uint64_t i = 0; i < hdr.count; i++) {
+    long long latency, late;
+
+    if (fread(&rec, sizeof(rec), 1, in) != 1) {
+      fprintf(stderr, "%s: truncated after %llu records\n", argv[1],
+              (unsigned long long)i);
+      break;
+    }
+    latency = (long long)(rec.wake_ns - rec.release_ns);
+    late = (long long)(rec.end_ns - (rec.release_ns + hdr.period_ns));
+    fprintf(out,
+            ",\n  {\"name\": \"cycle\", \"cat\": \"task\", \"ph\": \"X\", "
+            "\"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": "
+            "{\"cycle\": %llu, \"latency_ns\": %lld, \"ret\": %lld}}",
+            rel_us(rec.wake_ns, hdr.start_ns),
+            rel_us(rec.end_ns, rec.wake_ns), (unsigned long long)rec.cycle,
+            latency, (long long)rec.ret);
+    fprintf(out,
+            ",\n  {\"name\": \"latency_ns\", \"ph\": \"C\", \"pid\": 1, "
+            "\"ts\": %.3f, \"args\": {\"ns\": %lld}}",
+            rel_us(rec.wake_ns, hdr.start_ns), latency);
+    if (late > 0)
+      fprintf(out,
+              ",\n  {\"name\": \"overrun\", \"ph\": \"i\", \"s\": \"t\", "
+              "\"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"args\": "
+              "{\"late_ns\": %lld}}",
+              rel_us(rec.end_ns, hdr.start_ns), late);
+  }
+  fprintf(out, "\n]}\n");
+
+  fclose(in);
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}